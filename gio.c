@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
@@ -7,13 +8,23 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
 #include <getopt.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
 #include <mpi.h>
 
 
+#include "gio_codec.h"
+#include "gio_crc.h"
 #include "gio_err.h"
+#include "gio_hints.h"
 #include "gio_io.h"
 #include "gio_mem.h"
+#include "gio_pipe.h"
 #include "gio_util.h"
 
 #define OPT_LEN (32)
@@ -21,18 +32,52 @@
 
 #define GIO_LARGE_FILE
 
+/* Largest byte count passed to a single MPI-IO call */
+#define GIO_MAX_IO_COUNT (1 << 30)
+
+/* Slots in flight between the compute and I/O stages of a pipeline */
+#define GIO_PIPE_DEPTH (4)
+
+/* Smallest per-rank write used to probe a hint configuration */
+#define GIO_TUNE_MIN_PROBE (1 << 20)
+
+/* Tag of the token passed between ranks by open admission (-O token) */
+#define GIO_OPEN_TOKEN_TAG (101)
+
 double get_dtime(void);
 void usage(void);
+int  get_thread_level(int argc, char *argv[]);
+void check_path(const char *path, int len);
 void get_rank_path(char *mypath);
 void get_coll_io_path(char *mypath, int comm_size);
+void get_shard_dir(char *mydir, int rank);
+void make_shard_dirs();
+int  use_rank_files();
+int  open_rank_file(const char *path, int flags);
 
 int* create_io_data(int start_val);
+void fill_io_data(int *wdata, int val);
 void free_io_data(int *wdata);
 int  validate_io_data(int *data, int val);
+int  validate_io_range(int *data, size_t size, int val);
 
 void do_sequential_read();
+double sequential_read_pass(const char *path, int fd, char *data, const char *mode);
 void do_sequential_write();
+void do_node_aggregated_write();
+void do_threaded_io(int is_write);
+void do_tune();
+void do_m_sweep();
+void do_staged_write();
+void do_reshape_read();
+void do_compressed_io(int is_write);
+void do_checksummed_io(int is_write);
+void do_copy();
 void do_experiment();
+void do_scaling_series();
+void do_interference();
+void start_io_phase();
+void end_io_phase();
 
 
 static struct option option_table[] = {
@@ -41,6 +86,33 @@ static struct option option_table[] = {
   {"f", required_argument, 0, 0},
   {"d", required_argument, 0, 0},
   {"m", required_argument, 0, 0},
+  {"l", required_argument, 0, 0},
+  {"t", required_argument, 0, 0},
+  {"b", required_argument, 0, 0},
+  {"p", required_argument, 0, 0},
+  {"n", required_argument, 0, 0},
+  {"i", required_argument, 0, 0},
+  {"I", required_argument, 0, 0},
+  {"M", required_argument, 0, 0},
+  {"a", required_argument, 0, 0},
+  {"S", required_argument, 0, 0},
+  {"B", required_argument, 0, 0},
+  {"C", required_argument, 0, 0},
+  {"R", required_argument, 0, 0},
+  {"W", required_argument, 0, 0},
+  {"z", required_argument, 0, 0},
+  {"x", required_argument, 0, 0},
+  {"c", required_argument, 0, 0},
+  {"u", required_argument, 0, 0},
+  {"y", required_argument, 0, 0},
+  {"r", required_argument, 0, 0},
+  {"w", required_argument, 0, 0},
+  {"F", required_argument, 0, 0},
+  {"O", required_argument, 0, 0},
+  {"k", required_argument, 0, 0},
+  {"N", required_argument, 0, 0},
+  {"g", required_argument, 0, 0},
+  {"q", required_argument, 0, 0},
   {0, 0, 0, 0}
 };
 
@@ -59,6 +131,10 @@ static struct perf_times ptimes[] = {
   {"close_time   ", 0, 0}      //5
 };
 
+/* Communicator of the running experiment; MPI_COMM_WORLD unless a
+   scaling series (-S) runs it on a subset of the ranks. myrank and
+   world_comm_size refer to this communicator. */
+MPI_Comm gio_comm;
 int myrank;
 int world_comm_size;
 
@@ -68,15 +144,45 @@ char expr[OPT_LEN];
 int  scale_on = 0;
 char scale[OPT_LEN];
 int    data_size_on = 0;
-size_t data_size = 0;
+size_t data_size = 0;       /*Bytes per rank of the running experiment*/
+size_t input_data_size = 0; /*-f: bytes per rank (weak) or in total (strong)*/
+size_t block_size = sizeof(int); /*Strong scaling splits data at this granularity*/
+char series[OPT_LEN] = "none";   /*Scaling series over nodes or ranks*/
+double last_io_bandwidth = -1;
+char stage_path[PATH_LEN];       /*Fast local tier for staged writes*/
+int  stage_path_on = 0;
+size_t drain_chunk = 4 << 20;    /*Drain buffer per node (bytes)*/
+double drain_rate = 0;           /*Drain throttle per node (MB/s), 0: unlimited*/
+int  writer_count = 0;           /*Ranks that wrote the files read by rr, 0: same as readers*/
+char codec[OPT_LEN] = "lz";      /*Compression in zw: none, lz or zlib*/
+double compress_ratio = 1.0;     /*Compressibility of the data generated for zw/zr*/
+size_t pipe_chunk = 1 << 20;     /*Bytes per pipeline stage*/
+char source_path[PATH_LEN * 16]; /*Files copied by cp: a directory or a list of files*/
+int  source_path_on = 0;
+char copy_method[OPT_LEN] = "copy_file_range"; /*First method tried by cp*/
+char prefetch[OPT_LEN] = "none";  /*Prefetch of sr: none, fadvise, readahead or thread*/
+size_t prefetch_window = 8 << 20; /*Bytes kept read ahead by sr*/
+int  shard_count = 0;             /*Subdirectories per-rank files are spread over, 0: none*/
+char open_admission[OPT_LEN] = "none"; /*Staggering of per-rank opens: none, token or window*/
+int  open_window = 64;            /*Ranks opening at a time under open admission*/
+char noise[OPT_LEN] = "none";     /*Background load during I/O: none, alltoall, neighbor or membw*/
+size_t noise_size = 0;            /*Bytes per round of the background load, 0: default of the kind*/
+int  noise_rounds = 2;            /*Quiet/loaded pairs run by -N, in alternating order*/
 char target_path[PATH_LEN];
 int  target_path_on = 0;
 int  m_size_on = 0; /*M of NxM*/
 int  m_size = 0;
-
-/*Static value, which can not be changed*/
+char m_sweep[OPT_LEN * 4] = "all"; /*Set of M tried by the sweep experiment*/
+int  leaders_per_node = 1; /*Writers per node in node-aggregated mode*/
+int  thread_count = 1;      /*I/O threads per rank in tw/tr*/
+char io_backend[OPT_LEN] = "posix"; /*posix or mpiio for tw/tr and kw/kr*/
+char thread_pinning[OPT_LEN] = "none";  /*none, compact or scatter*/
+char thread_buffer[OPT_LEN]  = "local"; /*local (first touch per thread) or master*/
+int  thread_provided = MPI_THREAD_SINGLE;
+
+/*Default values, which can be overridden by hints (-i/-I)*/
 int max_striping_factor = 80; // if we use over 64 oss, deleting file operation hangs.
-char striping_factor[8];
+char striping_factor[GIO_HINT_LEN];
 //char *striping_unit =   "67108864"; //  64MB
 char *striping_unit =  "134217728";   // 128MB
 //char *striping_unit =  "536870912"; // 512MB
@@ -86,7 +192,14 @@ int main(int argc,char *argv[])
   int c;
   int option_index;
 
-  MPI_Init(&argc, &argv); 
+  int thread_level = get_thread_level(argc, argv);
+
+  if (thread_level != MPI_THREAD_SINGLE) {
+    MPI_Init_thread(&argc, &argv, thread_level, &thread_provided); 
+  } else {
+    MPI_Init(&argc, &argv); 
+  }
+  gio_comm = MPI_COMM_WORLD;
   MPI_Comm_rank(MPI_COMM_WORLD, &myrank); 
   MPI_Comm_size (MPI_COMM_WORLD, &world_comm_size); 
 
@@ -113,15 +226,187 @@ int main(int argc,char *argv[])
 	scale_on = 1;
 	break;
       case 2:
-	data_size = atoi(optarg);
+	input_data_size = atol(optarg);
 	data_size_on = 1;
 	break;
       case 3:
 	strcpy(target_path, optarg);
 	target_path_on = 1;
+	break;
       case 4:
 	m_size = atoi(optarg);
 	break;
+      case 5:
+	leaders_per_node = atoi(optarg);
+	if (leaders_per_node < 1) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 6:
+	thread_count = atoi(optarg);
+	if (thread_count < 1) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 7:
+	if (strlen(optarg) >= sizeof(io_backend)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(io_backend, optarg);
+	break;
+      case 8:
+	if (strlen(optarg) >= sizeof(thread_pinning)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(thread_pinning, optarg);
+	break;
+      case 9:
+	if (strlen(optarg) >= sizeof(thread_buffer)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(thread_buffer, optarg);
+	break;
+      case 10:
+	gio_hints_parse(optarg);
+	break;
+      case 11:
+	gio_hints_load(optarg);
+	break;
+      case 12:
+	if (strlen(optarg) >= sizeof(m_sweep)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(m_sweep, optarg);
+	break;
+      case 13:
+	block_size = atol(optarg);
+	if (block_size == 0 || block_size % sizeof(int) != 0) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 14:
+	if (strlen(optarg) >= sizeof(series)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(series, optarg);
+	break;
+      case 15:
+	if (strlen(optarg) >= sizeof(stage_path)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(stage_path, optarg);
+	stage_path_on = 1;
+	break;
+      case 16:
+	drain_chunk = atol(optarg);
+	if (drain_chunk == 0) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 17:
+	drain_rate = atof(optarg);
+	break;
+      case 18:
+	writer_count = atoi(optarg);
+	break;
+      case 19:
+	if (strlen(optarg) >= sizeof(codec)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(codec, optarg);
+	break;
+      case 20:
+	compress_ratio = atof(optarg);
+	if (compress_ratio < 1.0) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 21:
+	pipe_chunk = atol(optarg);
+	if (pipe_chunk == 0) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 22:
+	if (strlen(optarg) >= sizeof(source_path)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(source_path, optarg);
+	source_path_on = 1;
+	break;
+      case 23:
+	if (strlen(optarg) >= sizeof(copy_method)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(copy_method, optarg);
+	break;
+      case 24:
+	if (strlen(optarg) >= sizeof(prefetch)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(prefetch, optarg);
+	break;
+      case 25:
+	prefetch_window = atol(optarg);
+	if (prefetch_window == 0) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 26:
+	shard_count = atoi(optarg);
+	if (shard_count < 0) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 27:
+	if (strlen(optarg) >= sizeof(open_admission)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(open_admission, optarg);
+	break;
+      case 28:
+	open_window = atoi(optarg);
+	if (open_window < 1) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
+      case 29:
+	if (strlen(optarg) >= sizeof(noise)) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	strcpy(noise, optarg);
+	break;
+      case 30:
+	noise_size = atol(optarg);
+	break;
+      case 31:
+	noise_rounds = atoi(optarg);
+	if (noise_rounds < 1) {
+	  usage();
+	  exit(EXIT_FAILURE);
+	}
+	break;
       default:
 	gio_dbg("Unknown option\n");
 	usage();
@@ -142,19 +427,105 @@ int main(int argc,char *argv[])
     exit(EXIT_SUCCESS);
   }
 
-  if (strcmp(expr, "pw") == 0) {
+  if (strcmp(scale, "s") != 0 && strcmp(scale, "w") != 0) {
+    usage();
+    exit(EXIT_SUCCESS);
+  }
+
+  /* Every rank's share (and the strong scaling tail) holds whole ints */
+  if (input_data_size % sizeof(int) != 0) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  /* gio-level hints, the rest is passed to MPI_Info as is */
+  if (gio_hints_get("max_striping_factor") != NULL) {
+    max_striping_factor = atoi(gio_hints_get("max_striping_factor"));
+    gio_hints_unset("max_striping_factor");
+  }
+  if (gio_hints_get("striping_unit") != NULL) {
+    striping_unit = strdup(gio_hints_get("striping_unit"));
+  }
+
+  if (strcmp(expr, "pw") == 0 || strcmp(expr, "tune") == 0 || strcmp(expr, "rr") == 0) {
     if (m_size == 0) {
       usage();
       exit(EXIT_SUCCESS);
     }
   }
 
-  do_experiment();
+  if (strcmp(expr, "bw") == 0 && !stage_path_on) {
+    usage();
+    exit(EXIT_SUCCESS);
+  }
+
+  if (strcmp(expr, "cp") == 0 && !source_path_on) {
+    usage();
+    exit(EXIT_SUCCESS);
+  }
+
+  if (strcmp(series, "none") != 0 && strcmp(noise, "none") != 0) {
+    usage();
+    exit(EXIT_SUCCESS);
+  }
+
+  if (strcmp(series, "none") != 0) {
+    do_scaling_series();
+  } else if (strcmp(noise, "none") != 0) {
+    do_interference();
+  } else {
+    do_experiment();
+  }
 
   MPI_Finalize(); 
   return 0;
 }
 
+/* MPI_THREAD_MULTIPLE only for the experiments whose helper threads
+   call MPI (tw/tr over MPI-IO, bw and -N), so that the others are
+   measured without its locking cost. The other experiments that start
+   helper threads (tw/tr over POSIX, zw/zr, kw/kr and sr -r thread) get
+   MPI_THREAD_FUNNELED. The options are only looked at here; main()
+   parses them after MPI_Init. */
+int get_thread_level(int argc, char *argv[])
+{
+  char e[OPT_LEN] = "", b[OPT_LEN] = "posix", n[OPT_LEN] = "none", r[OPT_LEN] = "none";
+  int c, option_index;
+  int level = MPI_THREAD_SINGLE;
+
+  opterr = 0;
+  while ((c = getopt_long_only(argc, argv, "+", option_table, &option_index)) != EOF) {
+    if (c != 0 || strlen(optarg) >= OPT_LEN) continue;
+    switch (option_index) {
+    case 0:
+      strcpy(e, optarg);
+      break;
+    case 7:
+      strcpy(b, optarg);
+      break;
+    case 24:
+      strcpy(r, optarg);
+      break;
+    case 29:
+      strcpy(n, optarg);
+      break;
+    }
+  }
+  opterr = 1;
+  optind = 0; /* rescan from the start in main() */
+
+  if (((strcmp(e, "tw") == 0 || strcmp(e, "tr") == 0) && strcmp(b, "mpiio") == 0) ||
+      strcmp(e, "bw") == 0 || strcmp(n, "none") != 0) {
+    level = MPI_THREAD_MULTIPLE;
+  } else if (strcmp(e, "tw") == 0 || strcmp(e, "tr") == 0 ||
+	     strcmp(e, "zw") == 0 || strcmp(e, "zr") == 0 ||
+	     strcmp(e, "kw") == 0 || strcmp(e, "kr") == 0 ||
+	     (strcmp(e, "sr") == 0 && strcmp(r, "thread") == 0)) {
+    level = MPI_THREAD_FUNNELED;
+  }
+  return level;
+}
+
 void print_results()
 {
   struct perf_times *gathered_ptimes = NULL;
@@ -167,7 +538,7 @@ void print_results()
 
   MPI_Gather(ptimes, sizeof(ptimes), MPI_BYTE, 
 	     gathered_ptimes, sizeof(ptimes), MPI_BYTE,
-	     0, MPI_COMM_WORLD);
+	     0, gio_comm);
 
   if (myrank == 0) {
     for (i = 0; i < world_comm_size; i++) {
@@ -193,24 +564,126 @@ void print_results()
   return;
 }
 
+/* Print aggregate bandwidth over all ranks: io_time is taken from the
+   earliest io start to the latest io end, so that ranks which did not
+   issue any I/O (e.g. non-leaders) do not hide the slowest writer. */
+void print_bandwidth(double total_bytes)
+{
+  double local_start[2], local_end[2];
+  double start[2], end[2];
+
+  local_start[0] = ptimes[4].start;
+  local_start[1] = ptimes[0].start;
+  local_end[0]   = ptimes[4].end;
+  local_end[1]   = ptimes[0].end;
+  MPI_Reduce(local_start, start, 2, MPI_DOUBLE, MPI_MIN, 0, gio_comm);
+  MPI_Reduce(local_end,   end,   2, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("Total bytes         : %.0f", total_bytes);
+    gio_print("io_time (max)       : %f", end[0] - start[0]);
+    gio_print("total_time (max)    : %f", end[1] - start[1]);
+    gio_print("io bandwidth        : %f MB/s", total_bytes / (end[0] - start[0]) / 1e6);
+    gio_print("total bandwidth     : %f MB/s", total_bytes / (end[1] - start[1]) / 1e6);
+    last_io_bandwidth = total_bytes / (end[0] - start[0]);
+  }
+  return;
+}
+
+/* Bytes of rank out of nprocs: -f itself for weak scaling, or a share of
+   -f for strong scaling. The strong scaling share is a whole number of
+   block_size blocks, the first ranks take one extra block for the
+   remainder and the last rank takes the tail smaller than a block. */
+size_t get_local_data_size(int rank, int nprocs)
+{
+  size_t nblocks, size;
+
+  if (strcmp(scale, "w") == 0) {
+    return input_data_size;
+  }
+  nblocks = input_data_size / block_size;
+  size = (nblocks / nprocs + ((size_t)rank < nblocks % nprocs ? 1 : 0)) * block_size;
+  if (rank == nprocs - 1) {
+    size += input_data_size % block_size;
+  }
+  return size;
+}
+
+/* Offset of this rank's data in a file shared by comm, in rank order */
+MPI_Offset get_comm_offset(MPI_Comm comm)
+{
+  MPI_Offset size = data_size, offset = 0;
+  int rank;
+
+  MPI_Exscan(&size, &offset, 1, MPI_OFFSET, MPI_SUM, comm);
+  MPI_Comm_rank(comm, &rank);
+  if (rank == 0) offset = 0;
+  return offset;
+}
+
+/* Datatype of size bytes for a single MPI-IO call, built from ints as
+   pw does so that the count does not overflow an int beyond 2 GB */
+MPI_Datatype create_io_datatype(size_t size)
+{
+  MPI_Datatype type;
+
+  if (size % sizeof(int) != 0 || size / sizeof(int) > INT_MAX) {
+    gio_err("I/O size %lu is not a multiple of %lu or too large (%s:%s:%d)",
+	    size, sizeof(int), __FILE__, __func__, __LINE__);
+  }
+  MPI_Type_contiguous(size / sizeof(int), MPI_INT, &type);
+  MPI_Type_commit(&type);
+  return type;
+}
+
+double get_total_data_size()
+{
+  double size = data_size, total;
+  MPI_Allreduce(&size, &total, 1, MPI_DOUBLE, MPI_SUM, gio_comm);
+  return total;
+}
+
+
 
 
 
+/* Split nprocs ranks into groups of balanced size: the first
+   nprocs % groups groups get one extra rank. Returns the group of rank,
+   and its first rank and size if requested. */
+int get_balanced_group(int rank, int nprocs, int groups, int *group_start, int *group_size)
+{
+  int base, rem, color, start, size;
+
+  base = nprocs / groups;
+  rem = nprocs % groups;
+  if (rank < rem * (base + 1)) {
+    color = rank / (base + 1);
+    start = color * (base + 1);
+    size = base + 1;
+  } else {
+    color = rem + (rank - rem * (base + 1)) / base;
+    start = rem * (base + 1) + (color - rem) * base;
+    size = base;
+  }
+  if (group_start != NULL) *group_start = start;
+  if (group_size != NULL) *group_size = size;
+  return color;
+}
 
 int get_sub_collective_io_comm(MPI_Comm *sub_comm)
 {
-  int sub_comm_size, sub_comm_color;
+  int sub_comm_color;
 
   /* Construct sub collective I/O communicater 
      according to group_count
    */
-  if (world_comm_size % m_size != 0) {
-    gio_err("world_comm_size:%d can not be divided by m_size:%d (%s:%s:%d)", 
-	    world_comm_size, m_size, __FILE__, __func__, __LINE__);
+  if (m_size < 1 || m_size > world_comm_size) {
+    gio_err("m_size:%d must be between 1 and world_comm_size:%d (%s:%s:%d)", 
+	    m_size, world_comm_size, __FILE__, __func__, __LINE__);
   }
-  sub_comm_size = world_comm_size / m_size;
-  sub_comm_color = myrank / sub_comm_size;
-  MPI_Comm_split(MPI_COMM_WORLD, sub_comm_color, myrank, sub_comm);
+  sub_comm_color = get_balanced_group(myrank, world_comm_size, m_size, NULL, NULL);
+  MPI_Comm_split(gio_comm, sub_comm_color, myrank, sub_comm);
   return sub_comm_color;
 }
 
@@ -233,9 +706,23 @@ int validate_io_data(int *data, int val)
   return 1;  
 }
 
-int* create_io_data(int val)
+/* validate_io_data() on size bytes only (e.g. one block of a read) */
+int validate_io_range(int *data, size_t size, int val)
+{
+  size_t i;
+
+  for (i = 0; i < size / sizeof(int); i++) {
+    if (data[i] != val) {
+      gio_err("data is not validated at index %lu. Value:%d is expected, but is %d (%s:%s:%d)", 
+	      i, val, data[i], __FILE__, __func__, __LINE__);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void fill_io_data(int *wdata, int val)
 {
-  int *wdata;
   int int_count;
   int i;
 
@@ -244,13 +731,19 @@ int* create_io_data(int val)
 	    data_size, sizeof(int), __FILE__, __func__, __LINE__);
   }
 
-  wdata = (int*)gio_malloc(data_size);  
-
   int_count = data_size / sizeof(int);
   for (i = 0; i < int_count; i++) {
     wdata[i] = val;
   }
+  return;
+}
+
+int* create_io_data(int val)
+{
+  int *wdata;
 
+  wdata = (int*)gio_malloc(data_size);  
+  fill_io_data(wdata, val);
   return wdata;
 }
 
@@ -269,7 +762,7 @@ void do_collective_write()
   char coll_path[PATH_LEN];
   int sub_comm_size, sub_rank, sub_comm_color;
   int striping_factor_int;
-  int disp;
+  MPI_Offset disp;
   int rc;
   int *buf;
 
@@ -299,6 +792,7 @@ void do_collective_write()
   MPI_Info_set(info, "striping_unit", striping_unit);
   //  MPI_Info_set(info, "romio_cb_write", "enable");                                                                                                                                                       
   //  MPI_Info_set(info, "romio_cb_write", "disable");
+  gio_hints_apply(info);
 
   /* Get path to the target file of the communicator */
   MPI_Comm_size(sub_write_comm, &sub_comm_size);
@@ -309,6 +803,7 @@ void do_collective_write()
 
   /* Create write data*/
   MPI_Comm_rank(sub_write_comm, &sub_rank);
+  disp = get_comm_offset(sub_write_comm);
   buf = create_io_data(sub_rank);
   /* if (sub_rank == 0) { */
   /*   rc = MPI_File_delete(coll_path, MPI_INFO_NULL); */
@@ -318,7 +813,7 @@ void do_collective_write()
   /* } */
   ptimes[1].end = MPI_Wtime();
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(gio_comm);
 
   /* Open the file */
   //  gio_dbg("start ***********************");  
@@ -336,12 +831,8 @@ void do_collective_write()
   //  gio_dbg("start *********************** %d", sub_rank);  
   ptimes[3].start = MPI_Wtime();
   /* Set the file view for the output file. In this example, we will                                                                                                                                          * use the same contiguous datatype as we used for reading the data                                                                                                                                          * into local memory. A better example would be to write out just                                                                                                                                            * part of the data, say 4 contiguous elements followed by a gap of                                                                                                                                          * 4 elements, and repeated. */
-  disp = sub_rank * data_size;
 #ifdef GIO_LARGE_FILE
-  int i;
-  for (i = 0; i < sub_rank; i++) {
-    MPI_File_seek(fh, data_size, MPI_SEEK_CUR);
-  }
+  MPI_File_seek(fh, disp, MPI_SEEK_SET);
 #else  
   MPI_File_set_view(fh, disp, contig, contig, "native", info);
 #endif
@@ -352,12 +843,12 @@ void do_collective_write()
   //  gio_dbg("end ***********************");  
 
   /* MPI Collective Write */
-  ptimes[4].start = MPI_Wtime();
+  start_io_phase();
   rc = MPI_File_write_all(fh, buf, 1, contig, MPI_STATUS_IGNORE);
   if (rc != MPI_SUCCESS) {
     gio_err("MPI_File_set_view failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
   }
-  ptimes[4].end = MPI_Wtime();
+  end_io_phase();
 
   /*Free data*/
   free_io_data(buf);
@@ -369,6 +860,7 @@ void do_collective_write()
   ptimes[0].end = MPI_Wtime();
 
   print_results();
+  print_bandwidth(get_total_data_size());
 
   return;
 }
@@ -381,7 +873,7 @@ void do_collective_read()
   MPI_File fh;
   char coll_path[PATH_LEN];
   int sub_comm_size, sub_rank, sub_comm_color;
-  int disp;
+  MPI_Offset disp;
   int rc;
   int *buf;
 
@@ -402,6 +894,7 @@ void do_collective_read()
   //  MPI_Info_set(info, "striping_unit", striping_unit);
   MPI_Info_set(info, "romio_cb_read", "enable");                                                                                                                                                       
   //  MPI_Info_set(info, "romio_cb_read", "disable");
+  gio_hints_apply(info);
 
   /* Get path to the target file of the communicator */
   MPI_Comm_size(sub_read_comm, &sub_comm_size);
@@ -412,10 +905,11 @@ void do_collective_read()
 
   /* Create read data*/
   MPI_Comm_rank(sub_read_comm, &sub_rank);
+  disp = get_comm_offset(sub_read_comm);
   buf = create_io_data(-1);
   ptimes[1].end = MPI_Wtime();
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(gio_comm);
 
   /* Open the file */
   ptimes[2].start = MPI_Wtime();
@@ -430,12 +924,8 @@ void do_collective_read()
   /* Set the file view for the output file. In this example, we will                                                                                                                                          * use the same contiguous datatype as we used for reading the data                                                                                                                                          * into local memory. A better example would be to read out just                                                                                                                                            * part of the data, say 4 contiguous elements followed by a gap of                                                                                                                                          * 4 elements, and repeated. */
   ptimes[3].start = MPI_Wtime();
 #ifdef GIO_LARGE_FILE
-  int i;
-  for (i = 0; i < sub_rank; i++) {
-    MPI_File_seek(fh, data_size, MPI_SEEK_CUR);
-  }
+  MPI_File_seek(fh, disp, MPI_SEEK_SET);
 #else  
-  disp = sub_rank * data_size;
   MPI_File_set_view(fh, disp, contig, contig, "native", info);
 #endif
   if (rc != MPI_SUCCESS) {
@@ -444,12 +934,12 @@ void do_collective_read()
   ptimes[3].end = MPI_Wtime();
 
   /* MPI Collective Read */
-  ptimes[4].start = MPI_Wtime();
+  start_io_phase();
   rc = MPI_File_read_all(fh, buf, 1, contig, MPI_STATUS_IGNORE);
   if (rc != MPI_SUCCESS) {
     gio_err("MPI_File_set_view failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
   }
-  ptimes[4].end = MPI_Wtime();
+  end_io_phase();
 
   validate_io_data(buf, sub_rank);
 
@@ -463,132 +953,2497 @@ void do_collective_read()
   ptimes[0].end = MPI_Wtime();
 
   print_results();
+  print_bandwidth(get_total_data_size());
 
   return;
 }
 
-
-void do_sequential_write()
+/* Two-level write: ranks on the same node place their data into one
+   MPI-3 shared memory window (no copy), and a few leader ranks per node
+   write the whole node region with large, striping_unit aligned writes.
+   Each node owns an aligned region of a single shared file. */
+void do_node_aggregated_write()
 {
-  int fd;
-  char *addr;
-  size_t wsize;
-  char mypath[PATH_LEN];
+  MPI_Comm node_comm, leader_comm;
+  MPI_Win win;
+  MPI_Info info;
+  MPI_File fh;
+  MPI_Aint seg_size;
+  char node_path[PATH_LEN];
+  char *node_base;
+  int *buf;
+  int node_rank, node_size, node_count, is_first;
+  int leader_count, is_leader;
+  int seg_disp;
+  int rc;
+  MPI_Offset align, node_bytes, node_region, node_offset;
+  MPI_Offset chunk, begin, end, n;
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
 
+  MPI_Comm_split_type(gio_comm, MPI_COMM_TYPE_SHARED, myrank,
+		      MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_size(node_comm, &node_size);
 
-  if (myrank == 0) {
-    gio_dbg("Write: scale: %s, size: %lu", scale, data_size);
+  is_first = (node_rank == 0);
+  MPI_Allreduce(&is_first, &node_count, 1, MPI_INT, MPI_SUM, gio_comm);
+
+  leader_count = (leaders_per_node < node_size) ? leaders_per_node : node_size;
+  is_leader = (node_rank < leader_count);
+  MPI_Comm_split(gio_comm, is_leader ? 0 : MPI_UNDEFINED, myrank, &leader_comm);
+
+  /* Segments of a shared window are contiguous by default, so the node
+     data is a single buffer starting at the segment of node_rank 0 */
+  rc = MPI_Win_allocate_shared(data_size, sizeof(int), MPI_INFO_NULL,
+			       node_comm, &buf, &win);
+  if (rc != MPI_SUCCESS) {
+    gio_err("MPI_Win_allocate_shared failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
   }
+  MPI_Win_shared_query(win, 0, &seg_size, &seg_disp, &node_base);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+  fill_io_data(buf, myrank);
+
+  /* Each node region starts on a striping_unit boundary */
+  align = atol(striping_unit);
+  node_bytes = data_size;
+  MPI_Allreduce(MPI_IN_PLACE, &node_bytes, 1, MPI_OFFSET, MPI_SUM, node_comm);
+  node_region = is_first ? ((node_bytes + align - 1) / align) * align : 0;
+  node_offset = 0;
+  MPI_Exscan(&node_region, &node_offset, 1, MPI_OFFSET, MPI_SUM, gio_comm);
+  if (myrank == 0) node_offset = 0;
+  MPI_Bcast(&node_offset, 1, MPI_OFFSET, 0, node_comm);
 
-  get_rank_path(mypath);
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "striping_unit", striping_unit);
+  MPI_Info_set(info, "romio_cb_write", "disable");
+  gio_hints_apply(info);
+  check_path(node_path, snprintf(node_path, PATH_LEN, "%s/gio-file.node.%d", target_path, node_count));
+  ptimes[1].end = MPI_Wtime();
 
-  addr = (char*)gio_malloc(data_size);  
-  
-  fd = gio_open(mypath, O_WRONLY | O_CREAT, 0);
-  if (fd < 0) {
-    gio_err("File open failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  MPI_Barrier(gio_comm);
+
+  /* Open the file on the leaders only */
+  ptimes[2].start = MPI_Wtime();
+  if (is_leader) {
+    rc = MPI_File_open(leader_comm, node_path,
+		       MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &fh);
+    if (rc != MPI_SUCCESS) {
+      gio_err("MPI_File_open failed: %s  (%s:%s:%d)", node_path, __FILE__, __func__, __LINE__);
+    }
   }
+  ptimes[2].end = MPI_Wtime();
 
-  wsize = gio_write(mypath, fd, addr, data_size);
-  if (wsize != data_size) {
-    gio_err("Inputu wirte size is %f, but only %f bytes are written (%s:%s:%d)", data_size, wsize,__FILE__, __func__, __LINE__);
+  /* Aggregation: make every segment visible to the node leaders */
+  ptimes[3].start = MPI_Wtime();
+  MPI_Win_sync(win);
+  MPI_Barrier(node_comm);
+  MPI_Win_sync(win);
+  ptimes[3].end = MPI_Wtime();
+
+  /* Leaders split the node region at aligned boundaries */
+  start_io_phase();
+  if (is_leader) {
+    chunk = (node_bytes + leader_count - 1) / leader_count;
+    chunk = ((chunk + align - 1) / align) * align;
+    begin = chunk * node_rank;
+    end = begin + chunk;
+    if (begin > node_bytes) begin = node_bytes;
+    if (end > node_bytes) end = node_bytes;
+    while (begin < end) {
+      n = end - begin;
+      if (n > GIO_MAX_IO_COUNT) n = GIO_MAX_IO_COUNT;
+      rc = MPI_File_write_at(fh, node_offset + begin, node_base + begin,
+			     (int)n, MPI_BYTE, MPI_STATUS_IGNORE);
+      if (rc != MPI_SUCCESS) {
+	gio_err("MPI_File_write_at failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+      }
+      begin += n;
+    }
   }
+  end_io_phase();
 
-  gio_close(mypath, fd);
-  return;
-}
+  /* Close Files */
+  ptimes[5].start = MPI_Wtime();
+  if (is_leader) {
+    MPI_File_close(&fh);
+    MPI_Comm_free(&leader_comm);
+  }
+  ptimes[5].end = MPI_Wtime();
 
-void get_rank_path(char *mypath)
-{
-  sprintf(mypath, "%s/gio-file.%d.%d", target_path, myrank, getpid());
-  return;
-}
+  /* Keep the window alive until the leaders are done with it */
+  MPI_Barrier(node_comm);
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+  MPI_Info_free(&info);
+  MPI_Comm_free(&node_comm);
+  ptimes[0].end = MPI_Wtime();
+
+  if (myrank == 0) {
+    gio_print("# of nodes          : %d", node_count);
+  }
+  print_results();
+  print_bandwidth(get_total_data_size());
 
-void get_coll_io_path(char *mypath, int comm_color)
-{
-  sprintf(mypath, "%s/gio-file.coll.%d.%d", target_path, comm_color, m_size);
   return;
 }
 
 
+struct io_thread {
+  pthread_t thread;
+  int    tid;
+  int    cpu;
+  int    is_write;
+  int    fd;
+  MPI_File fh;
+  char   *path;
+  char   *buf;        /* NULL: thread allocates its own (NUMA-local) buffer */
+  size_t size;
+  off_t  offset;
+  double start;
+  double end;
+};
 
-void do_sequential_read()
+void* threaded_io_main(void *arg)
 {
-  int fd;
-  char *addr;
-  size_t wsize;
-  char mypath[PATH_LEN];
+  struct io_thread *t = (struct io_thread*)arg;
+  size_t done, n;
+  int owns_buf = 0;
+  int i, int_count;
+  int *data;
+  int rc;
 
-  if (myrank == 0) {
-    gio_dbg("Reade: scale: %s, size: %lu", scale, data_size);
+  if (t->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(t->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+      gio_dbg("pthread_setaffinity_np(cpu=%d) failed on thread %d", t->cpu, t->tid);
+    }
   }
 
-  get_rank_path(mypath);
+  /* First touch after pinning places the pages on the thread's NUMA node */
+  if (t->buf == NULL) {
+    t->buf = (char*)gio_malloc(t->size);
+    owns_buf = 1;
+    data = (int*)t->buf;
+    int_count = t->size / sizeof(int);
+    for (i = 0; i < int_count; i++) {
+      data[i] = t->is_write ? myrank : -1;
+    }
+  }
 
-  addr = (char*)gio_malloc(data_size);  
-  
-  fd = gio_open(mypath, O_WRONLY | O_CREAT, 0);
-  if (fd < 0) {
-    gio_err("File open failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  t->start = gio_get_time();
+  if (strcmp(io_backend, "mpiio") == 0) {
+    for (done = 0; done < t->size; done += n) {
+      n = t->size - done;
+      if (n > GIO_MAX_IO_COUNT) n = GIO_MAX_IO_COUNT;
+      if (t->is_write) {
+	rc = MPI_File_write_at(t->fh, t->offset + done, t->buf + done, (int)n,
+			       MPI_BYTE, MPI_STATUS_IGNORE);
+      } else {
+	rc = MPI_File_read_at(t->fh, t->offset + done, t->buf + done, (int)n,
+			      MPI_BYTE, MPI_STATUS_IGNORE);
+      }
+      if (rc != MPI_SUCCESS) {
+	gio_err("MPI-IO on thread %d failed: %s  (%s:%s:%d)", t->tid, t->path, __FILE__, __func__, __LINE__);
+      }
+    }
+  } else {
+    if (t->is_write) {
+      done = gio_pwrite(t->path, t->fd, t->buf, t->size, t->offset);
+    } else {
+      done = gio_pread(t->path, t->fd, t->buf, t->size, t->offset);
+    }
+    if (done != t->size) {
+      gio_err("Thread %d transferred %lu of %lu bytes: %s  (%s:%s:%d)",
+	      t->tid, done, t->size, t->path, __FILE__, __func__, __LINE__);
+    }
+  }
+  t->end = gio_get_time();
+
+  if (!t->is_write) {
+    data = (int*)t->buf;
+    int_count = t->size / sizeof(int);
+    for (i = 0; i < int_count; i++) {
+      if (data[i] != myrank) {
+	gio_err("data is not validated on thread %d at index %d. Value:%d is expected, but is %d (%s:%s:%d)",
+		t->tid, i, myrank, data[i], __FILE__, __func__, __LINE__);
+      }
+    }
   }
 
-  wsize = gio_write(mypath, fd, addr, data_size);
-  if (wsize != data_size) {
-    gio_err("Inputu wirte size is %f, but only %f bytes are written (%s:%s:%d)", data_size, wsize,__FILE__, __func__, __LINE__);
+  if (owns_buf) {
+    gio_free(t->buf);
   }
+  return NULL;
+}
 
-  gio_close(mypath, fd);
-  return;
+void get_thread_path(char *mypath)
+{
+  char mydir[PATH_LEN];
 
+  get_shard_dir(mydir, myrank);
+  check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.thread.%d", mydir, myrank));
+  return;
 }
 
-void do_experiment()
+/* Each of thread_count threads writes (reads) its own slice of the rank's
+   data_size bytes to (from) one file per rank, through POSIX pwrite/pread
+   or MPI-IO on MPI_COMM_SELF. Slices are whole ints and differ by at most
+   one int, so any data_size works under strong scaling. */
+void do_threaded_io(int is_write)
 {
-  if (myrank == 0) {
-    int sf = max_striping_factor / m_size;
-    if (sf == 0) sf = 1;
-    gio_print("===============================================");
-    gio_print("Experiment          : %s", expr);
-    gio_print("Scale               : %s", scale);
-    gio_print("local_data_size     : %d", data_size);
-    gio_print("Target path         : %s", target_path);
-    gio_print("# of processes      : %d", world_comm_size);
-    gio_print("# of files          : %d", m_size);
-    gio_print("max_striping_factor : %d", max_striping_factor);
-    gio_print("striping_factor     : %d", sf);
-    gio_print("striping_unit       : %s", striping_unit);
+  MPI_Comm node_comm;
+  MPI_File fh = MPI_FILE_NULL;
+  MPI_Info info;
+  struct io_thread *threads;
+  char mypath[PATH_LEN];
+  char *master_buf = NULL;
+  size_t slice;  /* ints of the rank */
+  cpu_set_t allowed;
+  int *cpus, ncpu;
+  int node_rank, node_size;
+  int use_mpiio;
+  int fd = -1;
+  int i, rc;
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+
+  use_mpiio = (strcmp(io_backend, "mpiio") == 0);
+  if (!use_mpiio && strcmp(io_backend, "posix") != 0) {
+    gio_err("Unknown I/O backend: %s (%s:%s:%d)", io_backend, __FILE__, __func__, __LINE__);
   }
-  MPI_Barrier(MPI_COMM_WORLD);
-  if (strcmp(expr, "sw") == 0) {
-    do_sequential_write();
-  } else if (strcmp(expr, "sr") == 0) {
-    do_sequential_read();
-  } else if (strcmp(expr, "pw") == 0) {
-    do_collective_write();
-  } else if (strcmp(expr, "pr") == 0) {
-    do_collective_read();
-  } else {
-    usage();
-    exit(EXIT_SUCCESS);
+  if (use_mpiio && thread_count > 1 && thread_provided < MPI_THREAD_MULTIPLE) {
+    gio_err("MPI_THREAD_MULTIPLE is not provided by this MPI (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  slice = data_size / sizeof(int);
+
+  MPI_Comm_split_type(gio_comm, MPI_COMM_TYPE_SHARED, myrank,
+		      MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_size(node_comm, &node_size);
+  MPI_Comm_free(&node_comm);
+  /* Pin only to the CPUs this rank may run on (e.g. under mpirun binding) */
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    gio_err("sched_getaffinity failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  cpus = (int*)gio_malloc(sizeof(int) * CPU_SETSIZE);
+  for (ncpu = 0, i = 0; i < CPU_SETSIZE; i++) {
+    if (CPU_ISSET(i, &allowed)) cpus[ncpu++] = i;
+  }
+
+  if (strcmp(thread_buffer, "master") == 0) {
+    master_buf = (char*)create_io_data(is_write ? myrank : -1);
   }
+
+  threads = (struct io_thread*)gio_malloc(sizeof(struct io_thread) * thread_count);
+  get_thread_path(mypath);
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  /* Open the file */
+  ptimes[2].start = MPI_Wtime();
+  if (use_mpiio) {
+    MPI_Info_create(&info);
+    gio_hints_apply(info);
+    rc = MPI_File_open(MPI_COMM_SELF, mypath,
+		       is_write ? MPI_MODE_WRONLY | MPI_MODE_CREATE : MPI_MODE_RDONLY,
+		       info, &fh);
+    if (rc != MPI_SUCCESS) {
+      gio_err("MPI_File_open failed: %s  (%s:%s:%d)", mypath, __FILE__, __func__, __LINE__);
+    }
+    MPI_Info_free(&info);
+  } else {
+    fd = gio_open(mypath, is_write ? O_WRONLY | O_CREAT : O_RDONLY, 0);
+  }
+  ptimes[2].end = MPI_Wtime();
+
+  ptimes[3].start = MPI_Wtime();
+  ptimes[3].end = MPI_Wtime();
+
+  /* Threaded I/O */
+  start_io_phase();
+  for (i = 0; i < thread_count; i++) {
+    struct io_thread *t = &threads[i];
+    t->tid = i;
+    t->is_write = is_write;
+    t->fd = fd;
+    t->fh = fh;
+    t->path = mypath;
+    t->offset = (off_t)(slice * i / thread_count) * sizeof(int);
+    t->size = (slice * (i + 1) / thread_count) * sizeof(int) - t->offset;
+    t->buf = master_buf ? master_buf + t->offset : NULL;
+    if (strcmp(thread_pinning, "compact") == 0) {
+      t->cpu = cpus[(node_rank * thread_count + i) % ncpu];
+    } else if (strcmp(thread_pinning, "scatter") == 0) {
+      t->cpu = cpus[(i * node_size + node_rank) % ncpu];
+    } else {
+      t->cpu = -1;
+    }
+    if (pthread_create(&t->thread, NULL, threaded_io_main, t) != 0) {
+      gio_err("pthread_create failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+    }
+  }
+  for (i = 0; i < thread_count; i++) {
+    pthread_join(threads[i].thread, NULL);
+  }
+  end_io_phase();
+
+  /* Close Files */
+  ptimes[5].start = MPI_Wtime();
+  if (use_mpiio) {
+    MPI_File_close(&fh);
+  } else {
+    gio_close(mypath, fd);
+  }
+  ptimes[5].end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  if (master_buf) {
+    free_io_data((int*)master_buf);
+  }
+  gio_free(threads);
+  gio_free(cpus);
+
+  print_results();
+  print_bandwidth(get_total_data_size());
+  return;
+}
+
+struct tune_config {
+  char   cb_write[8];
+  int    cb_nodes;
+  long   cb_buffer_size;
+  int    striping_factor;
+  long   striping_unit;
+  double bandwidth;
+};
+
+void set_tune_info(MPI_Info info, struct tune_config *cfg)
+{
+  char val[GIO_HINT_LEN];
+
+  gio_hints_apply(info);
+  sprintf(val, "%d", cfg->striping_factor);
+  MPI_Info_set(info, "striping_factor", val);
+  sprintf(val, "%ld", cfg->striping_unit);
+  MPI_Info_set(info, "striping_unit", val);
+  MPI_Info_set(info, "romio_cb_write", cfg->cb_write);
+  if (strcmp(cfg->cb_write, "enable") == 0) {
+    sprintf(val, "%d", cfg->cb_nodes);
+    MPI_Info_set(info, "cb_nodes", val);
+    sprintf(val, "%ld", cfg->cb_buffer_size);
+    MPI_Info_set(info, "cb_buffer_size", val);
+  }
+  return;
+}
+
+void print_tune_config(const char *prefix, struct tune_config *cfg)
+{
+  if (strcmp(cfg->cb_write, "enable") == 0) {
+    gio_print("%s%10.2f MB/s  striping_factor=%d,striping_unit=%ld,romio_cb_write=%s,cb_nodes=%d,cb_buffer_size=%ld",
+	      prefix, cfg->bandwidth / 1e6, cfg->striping_factor, cfg->striping_unit,
+	      cfg->cb_write, cfg->cb_nodes, cfg->cb_buffer_size);
+  } else {
+    gio_print("%s%10.2f MB/s  striping_factor=%d,striping_unit=%ld,romio_cb_write=%s",
+	      prefix, cfg->bandwidth / 1e6, cfg->striping_factor, cfg->striping_unit,
+	      cfg->cb_write);
+  }
+  return;
+}
+
+int compare_tune_config(const void *a, const void *b)
+{
+  const struct tune_config *x = a, *y = b;
+  if (x->bandwidth < y->bandwidth) return 1;
+  if (x->bandwidth > y->bandwidth) return -1;
+  return 0;
+}
+
+/* One short probe: a fresh pw-style collective write of probe_size bytes
+   per rank. The file is deleted first so that striping hints take effect. */
+double tune_probe(MPI_Comm sub_comm, int sub_rank, char *path, int *buf,
+		  size_t probe_size, struct tune_config *cfg)
+{
+  MPI_Datatype contig;
+  MPI_Info info;
+  MPI_File fh;
+  MPI_Offset size = probe_size, offset = 0;
+  double start, elapsed, max_elapsed, total;
+  int rc;
+
+  /* Under strong scaling the probe sizes differ between ranks */
+  MPI_Exscan(&size, &offset, 1, MPI_OFFSET, MPI_SUM, sub_comm);
+  if (sub_rank == 0) offset = 0;
+  contig = create_io_datatype(probe_size);
+  MPI_Info_create(&info);
+  set_tune_info(info, cfg);
+
+  if (sub_rank == 0) {
+    MPI_File_delete(path, MPI_INFO_NULL);
+  }
+  MPI_Barrier(gio_comm);
+
+  start = MPI_Wtime();
+  rc = MPI_File_open(sub_comm, path, MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &fh);
+  if (rc != MPI_SUCCESS) {
+    gio_err("MPI_File_open failed: %s  (%s:%s:%d)", path, __FILE__, __func__, __LINE__);
+  }
+  rc = MPI_File_write_at_all(fh, offset, buf, 1, contig, MPI_STATUS_IGNORE);
+  if (rc != MPI_SUCCESS) {
+    gio_err("MPI_File_write_at_all failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  MPI_File_close(&fh);
+  elapsed = MPI_Wtime() - start;
+  MPI_Info_free(&info);
+  MPI_Type_free(&contig);
+
+  MPI_Allreduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, gio_comm);
+  total = probe_size;
+  MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_DOUBLE, MPI_SUM, gio_comm);
+  return total / max_elapsed;
+}
+
+/* Values searched for one hint: the user's value if it was given with
+   -i/-I, otherwise the defaults */
+int tune_values(const char *key, long *values, long *defaults, int count)
+{
+  int i, n = 0;
+
+  if (gio_hints_get(key) != NULL) {
+    values[0] = atol(gio_hints_get(key));
+    return 1;
+  }
+  for (i = 0; i < count; i++) {
+    if (defaults[i] < 1) continue;
+    if (n > 0 && values[n - 1] == defaults[i]) continue;
+    values[n++] = defaults[i];
+  }
+  return n;
+}
+
+/* Search cb_nodes, cb_buffer_size, striping_factor/striping_unit and
+   collective buffering on/off with successive halving: every candidate
+   is probed with a small write, the better half survives and the probe
+   size doubles, until one configuration is left. */
+void do_tune()
+{
+  MPI_Comm sub_comm;
+  struct tune_config *cfgs;
+  char path[PATH_LEN];
+  char prefix[32];
+  long cb_nodes[4], cb_buffer[3], factor[4], unit[4];
+  long d_cb_nodes[4], d_cb_buffer[3] = {4L << 20, 16L << 20, 64L << 20};
+  long d_factor[4], d_unit[4] = {1L << 20, 4L << 20, 16L << 20, 128L << 20};
+  const char *cb_write[2] = {"enable", "disable"};
+  int n_cb_nodes, n_cb_buffer, n_factor, n_unit, n_cb_write;
+  int sub_comm_size, sub_rank, sub_comm_color;
+  int max_factor, count, round, i, a, b, c, d, e;
+  size_t probe_size;
+  int *buf;
+
+  sub_comm_color = get_sub_collective_io_comm(&sub_comm);
+  MPI_Comm_size(sub_comm, &sub_comm_size);
+  MPI_Comm_rank(sub_comm, &sub_rank);
+  check_path(path, snprintf(path, PATH_LEN, "%s/gio-file.tune.%d.%d", target_path, sub_comm_color, m_size));
+
+  max_factor = max_striping_factor / m_size;
+  if (max_factor == 0) max_factor = 1;
+  d_factor[0] = 1;
+  d_factor[1] = max_factor / 4;
+  d_factor[2] = max_factor / 2;
+  d_factor[3] = max_factor;
+  d_cb_nodes[0] = 1;
+  d_cb_nodes[1] = sub_comm_size / 4;
+  d_cb_nodes[2] = sub_comm_size / 2;
+  d_cb_nodes[3] = sub_comm_size;
+
+  n_cb_nodes  = tune_values("cb_nodes", cb_nodes, d_cb_nodes, 4);
+  n_cb_buffer = tune_values("cb_buffer_size", cb_buffer, d_cb_buffer, 3);
+  n_factor    = tune_values("striping_factor", factor, d_factor, 4);
+  n_unit      = tune_values("striping_unit", unit, d_unit, 4);
+  n_cb_write  = 2;
+  if (gio_hints_get("romio_cb_write") != NULL) {
+    cb_write[0] = gio_hints_get("romio_cb_write");
+    n_cb_write = 1;
+  }
+
+  /* Build the candidate list; cb_nodes/cb_buffer_size only matter with
+     collective buffering enabled */
+  cfgs = (struct tune_config*)gio_malloc(sizeof(struct tune_config) *
+					 n_cb_write * n_cb_nodes * n_cb_buffer * n_factor * n_unit);
+  count = 0;
+  for (a = 0; a < n_cb_write; a++) {
+    int enabled = (strcmp(cb_write[a], "disable") != 0);
+    for (b = 0; b < (enabled ? n_cb_nodes : 1); b++) {
+      for (c = 0; c < (enabled ? n_cb_buffer : 1); c++) {
+	for (d = 0; d < n_factor; d++) {
+	  for (e = 0; e < n_unit; e++) {
+	    struct tune_config *cfg = &cfgs[count++];
+	    strncpy(cfg->cb_write, cb_write[a], sizeof(cfg->cb_write) - 1);
+	    cfg->cb_write[sizeof(cfg->cb_write) - 1] = '\0';
+	    cfg->cb_nodes = cb_nodes[b];
+	    cfg->cb_buffer_size = cb_buffer[c];
+	    cfg->striping_factor = factor[d];
+	    cfg->striping_unit = unit[e];
+	    cfg->bandwidth = 0;
+	  }
+	}
+      }
+    }
+  }
+
+  /* Start small enough that the last round probes with data_size */
+  probe_size = data_size;
+  for (i = 1; i < count; i *= 2) {
+    probe_size /= 2;
+  }
+  if (probe_size < GIO_TUNE_MIN_PROBE) probe_size = GIO_TUNE_MIN_PROBE;
+  if (probe_size > data_size) probe_size = data_size;
+  probe_size -= probe_size % sizeof(int);
+  buf = create_io_data(sub_rank);
+
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("Tuning %d configurations", count);
+  }
+
+  for (round = 0; count > 1; round++) {
+    for (i = 0; i < count; i++) {
+      cfgs[i].bandwidth = tune_probe(sub_comm, sub_rank, path, buf, probe_size, &cfgs[i]);
+    }
+    qsort(cfgs, count, sizeof(struct tune_config), compare_tune_config);
+    if (myrank == 0) {
+      gio_print("round %d: %d configurations, probe size %lu bytes/rank", round, count, probe_size);
+      for (i = 0; i < count && i < 3; i++) {
+	sprintf(prefix, "  #%d ", i + 1);
+	print_tune_config(prefix, &cfgs[i]);
+      }
+    }
+    count = (count + 1) / 2;
+    probe_size *= 2;
+    if (probe_size > data_size) probe_size = data_size;
+    probe_size -= probe_size % sizeof(int);
+  }
+
+  if (sub_rank == 0) {
+    MPI_File_delete(path, MPI_INFO_NULL);
+  }
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("Best configuration for %d processes, %d files, %lu bytes/rank:",
+	      world_comm_size, m_size, data_size);
+    print_tune_config("  ", &cfgs[0]);
+  }
+
+  free_io_data(buf);
+  gio_free(cfgs);
+  MPI_Comm_free(&sub_comm);
+  return;
+}
+
+/* Parse the -M set ("all", or "1,2,4-8") into a list of file counts
+   between 1 and world_comm_size, each listed once; ms has
+   world_comm_size slots */
+int parse_m_sweep(int *ms)
+{
+  char *copy, *tok, *save, *dash;
+  char *seen;
+  int count = 0;
+  int lo, hi, m;
+
+  if (strcmp(m_sweep, "all") == 0) {
+    for (m = 1; m <= world_comm_size; m++) {
+      ms[count++] = m;
+    }
+    return count;
+  }
+  copy = strdup(m_sweep);
+  seen = (char*)gio_malloc(world_comm_size + 1);
+  memset(seen, 0, world_comm_size + 1);
+  for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+    lo = hi = atoi(tok);
+    if ((dash = strchr(tok, '-')) != NULL) {
+      hi = atoi(dash + 1);
+    }
+    for (m = lo; m <= hi; m++) {
+      if (m < 1 || m > world_comm_size) {
+	gio_err("File count %d is out of range 1..%d (%s:%s:%d)",
+		m, world_comm_size, __FILE__, __func__, __LINE__);
+      }
+      /* Repeated counts are run once */
+      if (seen[m]) continue;
+      seen[m] = 1;
+      if (count == world_comm_size) {
+	gio_err("-M lists more than %d file counts (%s:%s:%d)",
+		world_comm_size, __FILE__, __func__, __LINE__);
+      }
+      ms[count++] = m;
+    }
+  }
+  gio_free(seen);
+  free(copy);
+  return count;
+}
+
+/* Run the pw experiment for every M in -M within one launch. The write
+   buffer is allocated once and reused, and uneven splits are handled by
+   balanced group sizes. */
+void do_m_sweep()
+{
+  MPI_Comm sub_comm;
+  MPI_Datatype contig;
+  MPI_Info info;
+  MPI_File fh;
+  char coll_path[PATH_LEN];
+  char factor[GIO_HINT_LEN];
+  double t[4], local[3], elapsed[3];
+  double *results;
+  double total_bytes;
+  int *ms;
+  int count, k, rc;
+  int sub_rank, sub_comm_color, group_size, min_group, max_group;
+  int *buf;
+
+  ms = (int*)gio_malloc(sizeof(int) * world_comm_size);
+  count = parse_m_sweep(ms);
+  total_bytes = get_total_data_size();
+  results = (double*)gio_malloc(sizeof(double) * 5 * count);
+  buf = create_io_data(0);
+  contig = create_io_datatype(data_size);
+
+  for (k = 0; k < count; k++) {
+    m_size = ms[k];
+    sub_comm_color = get_sub_collective_io_comm(&sub_comm);
+    MPI_Comm_rank(sub_comm, &sub_rank);
+    MPI_Comm_size(sub_comm, &group_size);
+    get_coll_io_path(coll_path, sub_comm_color);
+    fill_io_data(buf, sub_rank);
+
+    MPI_Info_create(&info);
+    sprintf(factor, "%d", (max_striping_factor / m_size > 0) ? max_striping_factor / m_size : 1);
+    MPI_Info_set(info, "striping_factor", factor);
+    MPI_Info_set(info, "striping_unit", striping_unit);
+    gio_hints_apply(info);
+
+    MPI_Barrier(gio_comm);
+    t[0] = MPI_Wtime();
+    rc = MPI_File_open(sub_comm, coll_path, MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &fh);
+    if (rc != MPI_SUCCESS) {
+      gio_err("MPI_File_open failed: %s  (%s:%s:%d)", coll_path, __FILE__, __func__, __LINE__);
+    }
+    t[1] = MPI_Wtime();
+    rc = MPI_File_write_at_all(fh, get_comm_offset(sub_comm), buf,
+			       1, contig, MPI_STATUS_IGNORE);
+    if (rc != MPI_SUCCESS) {
+      gio_err("MPI_File_write_at_all failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+    }
+    t[2] = MPI_Wtime();
+    MPI_File_close(&fh);
+    t[3] = MPI_Wtime();
+
+    local[0] = t[1] - t[0];
+    local[1] = t[2] - t[1];
+    local[2] = t[3] - t[0];
+    MPI_Reduce(local, elapsed, 3, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+    MPI_Reduce(&group_size, &min_group, 1, MPI_INT, MPI_MIN, 0, gio_comm);
+    MPI_Reduce(&group_size, &max_group, 1, MPI_INT, MPI_MAX, 0, gio_comm);
+    results[k * 5 + 0] = elapsed[0];
+    results[k * 5 + 1] = elapsed[1];
+    results[k * 5 + 2] = elapsed[2];
+    results[k * 5 + 3] = min_group;
+    results[k * 5 + 4] = max_group;
+
+    MPI_Info_free(&info);
+    MPI_Comm_free(&sub_comm);
+  }
+
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("files\tranks/file\topen_time\tio_time  \ttotal_time\tbandwidth(MB/s)");
+    for (k = 0; k < count; k++) {
+      double *r = &results[k * 5];
+      gio_print("%d\t%d-%d\t\t%f\t%f\t%f\t%f",
+		ms[k], (int)r[3], (int)r[4], r[0], r[1], r[2],
+		total_bytes / r[2] / 1e6);
+    }
+  }
+
+  MPI_Type_free(&contig);
+  free_io_data(buf);
+  gio_free(results);
+  gio_free(ms);
+  return;
+}
+
+#define GIO_DRAIN_READY_TAG (100)
+
+struct drain_thread {
+  pthread_t thread;
+  MPI_Comm  comm;      /* node communicator owned by the drain thread */
+  int       *ranks;    /* gio_comm rank of every rank on the node */
+  int       count;
+  double    bytes;
+  double    end;
+};
+
+void get_stage_path(char *mypath, const char *dir, int rank)
+{
+  check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.stage.%d", dir, rank));
+  return;
+}
+
+/* Copy every staged file of the node to target_path as soon as its
+   writer reports it ready, through one drain_chunk buffer and at most
+   drain_rate MB/s, then fsync the copy and remove the staged file. */
+void* drain_main(void *arg)
+{
+  struct drain_thread *d = (struct drain_thread*)arg;
+  char src_path[PATH_LEN], dst_path[PATH_LEN];
+  char *buf;
+  double start;
+  ssize_t n;
+  int src, dst;
+  int i, ready;
+
+  buf = (char*)gio_malloc(drain_chunk);
+  start = MPI_Wtime();
+  for (i = 0; i < d->count; i++) {
+    MPI_Recv(&ready, 1, MPI_INT, MPI_ANY_SOURCE, GIO_DRAIN_READY_TAG, d->comm, MPI_STATUS_IGNORE);
+    get_stage_path(src_path, stage_path, d->ranks[ready]);
+    get_stage_path(dst_path, target_path, d->ranks[ready]);
+    src = gio_open(src_path, O_RDONLY, 0);
+    dst = gio_open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0);
+    while ((n = gio_read(src_path, src, buf, drain_chunk)) > 0) {
+      gio_write(dst_path, dst, buf, n);
+      d->bytes += n;
+      if (drain_rate > 0) {
+	double ahead = d->bytes / (drain_rate * 1e6) - (MPI_Wtime() - start);
+	if (ahead > 0) usleep((useconds_t)(ahead * 1e6));
+      }
+    }
+    close(src);
+    gio_close(dst_path, dst);
+    unlink(src_path);
+  }
+  d->end = MPI_Wtime();
+  gio_free(buf);
+  return NULL;
+}
+
+/* Burst-buffer staging: every rank writes its file to the fast tier
+   (-B) and goes on; a drain thread on the first rank of each node copies
+   the node's files to target_path in the background. Reports the time
+   ranks were blocked against the time until the data was durable on
+   target_path. */
+void do_staged_write()
+{
+  MPI_Comm node_comm;
+  struct drain_thread drain;
+  char mypath[PATH_LEN];
+  double local[3], global[3];
+  double durable_end, total_bytes;
+  struct stat stage_st, target_st;
+  int node_rank, node_size;
+  int fd;
+  size_t wsize;
+  int *buf;
+
+  if (thread_provided < MPI_THREAD_MULTIPLE) {
+    gio_err("MPI_THREAD_MULTIPLE is not provided by this MPI (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  /* The drain truncates its copy and removes the staged file */
+  if (stat(stage_path, &stage_st) == 0 && stat(target_path, &target_st) == 0 &&
+      stage_st.st_dev == target_st.st_dev && stage_st.st_ino == target_st.st_ino) {
+    gio_err("Staging path %s is the target path %s (%s:%s:%d)", stage_path, target_path, __FILE__, __func__, __LINE__);
+  }
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+  MPI_Comm_split_type(gio_comm, MPI_COMM_TYPE_SHARED, myrank,
+		      MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_size(node_comm, &node_size);
+
+  memset(&drain, 0, sizeof(drain));
+  if (node_rank == 0) {
+    drain.ranks = (int*)gio_malloc(sizeof(int) * node_size);
+    drain.count = node_size;
+  }
+  MPI_Gather(&myrank, 1, MPI_INT, drain.ranks, 1, MPI_INT, 0, node_comm);
+  MPI_Comm_dup(node_comm, &drain.comm);
+  if (node_rank == 0) {
+    if (pthread_create(&drain.thread, NULL, drain_main, &drain) != 0) {
+      gio_err("pthread_create failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+    }
+  }
+
+  get_stage_path(mypath, stage_path, myrank);
+  buf = create_io_data(myrank);
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  /* Blocking part: write to the fast tier */
+  ptimes[2].start = MPI_Wtime();
+  fd = gio_open(mypath, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  ptimes[2].end = MPI_Wtime();
+
+  start_io_phase();
+  wsize = gio_write(mypath, fd, buf, data_size);
+  if (wsize != data_size) {
+    gio_err("Input write size is %lu, but only %lu bytes are written (%s:%s:%d)", data_size, wsize, __FILE__, __func__, __LINE__);
+  }
+  end_io_phase();
+
+  ptimes[5].start = MPI_Wtime();
+  gio_close(mypath, fd);
+  ptimes[5].end = MPI_Wtime();
+
+  /* Hand the file over to the drain thread */
+  MPI_Send(&node_rank, 1, MPI_INT, 0, GIO_DRAIN_READY_TAG, drain.comm);
+  free_io_data(buf);
+  ptimes[0].end = MPI_Wtime();
+
+  /* The application would compute here; wait for durability */
+  durable_end = 0;
+  if (node_rank == 0) {
+    pthread_join(drain.thread, NULL);
+    durable_end = drain.end;
+    gio_free(drain.ranks);
+  }
+  MPI_Comm_free(&drain.comm);
+  MPI_Comm_free(&node_comm);
+
+  print_results();
+  print_bandwidth(get_total_data_size());
+
+  local[0] = ptimes[5].end - ptimes[2].start;
+  local[1] = durable_end;
+  local[2] = -ptimes[2].start;
+  MPI_Reduce(local, global, 3, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+  MPI_Reduce(&drain.bytes, &total_bytes, 1, MPI_DOUBLE, MPI_SUM, 0, gio_comm);
+  if (myrank == 0) {
+    double durable = global[1] + global[2];
+    gio_print("blocked time (max)  : %f", global[0]);
+    gio_print("time to durability  : %f", durable);
+    gio_print("drained bytes       : %.0f", total_bytes);
+    gio_print("durable bandwidth   : %f MB/s", total_bytes / durable / 1e6);
+  }
+  return;
+}
+
+/* Bytes of the rr exchange as an int count of ints */
+int check_alltoallv_ints(MPI_Offset bytes)
+{
+  if (bytes / sizeof(int) > INT_MAX) {
+    gio_err("Redistribution of %lld bytes between two ranks exceeds the int count of MPI_Alltoallv (%s:%s:%d)",
+	    (long long)bytes, __FILE__, __func__, __LINE__);
+  }
+  return (int)(bytes / sizeof(int));
+}
+
+/* Restart read with a different process count: the m_size files written
+   by pw on writer_count ranks are read by world_comm_size ranks. The
+   writers' data is one stream in writer rank order; each reader reads a
+   balanced byte range of it with large contiguous reads, then the data is
+   redistributed with MPI_Alltoallv so that each reader owns whole writer
+   blocks, which it verifies. */
+void do_reshape_read()
+{
+  MPI_File *fhs;
+  MPI_Info info;
+  char coll_path[PATH_LEN];
+  MPI_Offset *wsize, *wstart, *foffset;
+  MPI_Offset total, begin, end, own_begin, own_end, b, e, n;
+  int *wgroup, *wvalue, *owner;
+  int *sendcounts, *sdispls, *recvcounts, *rdispls;
+  char *rbuf, *obuf;
+  double redist_start, redist_end, verify_end;
+  double local[2], global[2], total_bytes;
+  int nw, w, p, g, gstart, first_file, last_file;
+  int first_block, last_block, own_first, own_last;
+  int rc, i;
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+
+  nw = writer_count ? writer_count : world_comm_size;
+  if (m_size < 1 || m_size > nw) {
+    gio_err("m_size:%d must be between 1 and the writer count:%d (%s:%s:%d)",
+	    m_size, nw, __FILE__, __func__, __LINE__);
+  }
+
+  /* Layout of the writers: size, position in the stream, file, offset
+     in the file, the value pw wrote and the reader owning the block */
+  wsize   = (MPI_Offset*)gio_malloc(sizeof(MPI_Offset) * nw);
+  wstart  = (MPI_Offset*)gio_malloc(sizeof(MPI_Offset) * (nw + 1));
+  foffset = (MPI_Offset*)gio_malloc(sizeof(MPI_Offset) * nw);
+  wgroup  = (int*)gio_malloc(sizeof(int) * nw);
+  wvalue  = (int*)gio_malloc(sizeof(int) * nw);
+  owner   = (int*)gio_malloc(sizeof(int) * nw);
+  wstart[0] = 0;
+  for (w = 0; w < nw; w++) {
+    wsize[w] = get_local_data_size(w, nw);
+    wstart[w + 1] = wstart[w] + wsize[w];
+    wgroup[w] = get_balanced_group(w, nw, m_size, &gstart, NULL);
+    wvalue[w] = w - gstart;
+    foffset[w] = (w == gstart) ? 0 : foffset[w - 1] + wsize[w - 1];
+    owner[w] = (int)((long)w * world_comm_size / nw);
+  }
+  total = wstart[nw];
+
+  /* Balanced byte range of the stream read by this rank, in whole ints */
+  begin = (total / sizeof(int)) * myrank / world_comm_size * sizeof(int);
+  end = (total / sizeof(int)) * (myrank + 1) / world_comm_size * sizeof(int);
+  first_block = last_block = -1;
+  for (w = 0; w < nw; w++) {
+    if (wstart[w + 1] > begin && wstart[w] < end) {
+      if (first_block < 0) first_block = w;
+      last_block = w;
+    }
+  }
+  rbuf = (char*)gio_malloc(end - begin > 0 ? end - begin : 1);
+
+  /* Writer blocks owned by this rank after redistribution */
+  own_first = own_last = -1;
+  for (w = 0; w < nw; w++) {
+    if (owner[w] == myrank) {
+      if (own_first < 0) own_first = w;
+      own_last = w;
+    }
+  }
+  own_begin = (own_first < 0) ? 0 : wstart[own_first];
+  own_end = (own_first < 0) ? 0 : wstart[own_last + 1];
+  obuf = (char*)gio_malloc(own_end - own_begin > 0 ? own_end - own_begin : 1);
+
+  /* Alltoallv plan: ranges of the stream are contiguous on both sides.
+     Counts and displacements are in ints, which every range is made of,
+     and must fit the int arguments of MPI_Alltoallv. */
+  sendcounts = (int*)gio_malloc(sizeof(int) * world_comm_size);
+  sdispls    = (int*)gio_malloc(sizeof(int) * world_comm_size);
+  recvcounts = (int*)gio_malloc(sizeof(int) * world_comm_size);
+  rdispls    = (int*)gio_malloc(sizeof(int) * world_comm_size);
+  for (p = 0; p < world_comm_size; p++) {
+    MPI_Offset pb, pe, ob, oe;
+    int pf = -1, pl = -1;
+    /* What p owns, intersected with what this rank read */
+    for (w = 0; w < nw; w++) {
+      if (owner[w] == p) {
+	if (pf < 0) pf = w;
+	pl = w;
+      }
+    }
+    ob = (pf < 0) ? 0 : wstart[pf];
+    oe = (pf < 0) ? 0 : wstart[pl + 1];
+    b = (ob > begin) ? ob : begin;
+    e = (oe < end) ? oe : end;
+    sendcounts[p] = (e > b) ? check_alltoallv_ints(e - b) : 0;
+    sdispls[p] = (e > b) ? check_alltoallv_ints(b - begin) : 0;
+    /* What p read, intersected with what this rank owns */
+    pb = (total / sizeof(int)) * p / world_comm_size * sizeof(int);
+    pe = (total / sizeof(int)) * (p + 1) / world_comm_size * sizeof(int);
+    b = (pb > own_begin) ? pb : own_begin;
+    e = (pe < own_end) ? pe : own_end;
+    recvcounts[p] = (e > b) ? check_alltoallv_ints(e - b) : 0;
+    rdispls[p] = (e > b) ? check_alltoallv_ints(b - own_begin) : 0;
+  }
+
+  MPI_Info_create(&info);
+  gio_hints_apply(info);
+  first_file = (first_block < 0) ? 0 : wgroup[first_block];
+  last_file = (first_block < 0) ? -1 : wgroup[last_block];
+  fhs = (MPI_File*)gio_malloc(sizeof(MPI_File) * (last_file - first_file + 1 > 0 ? last_file - first_file + 1 : 1));
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  /* Open the files this rank reads from */
+  ptimes[2].start = MPI_Wtime();
+  for (g = first_file; g <= last_file; g++) {
+    get_coll_io_path(coll_path, g);
+    rc = MPI_File_open(MPI_COMM_SELF, coll_path, MPI_MODE_RDONLY, info, &fhs[g - first_file]);
+    if (rc != MPI_SUCCESS) {
+      gio_err("MPI_File_open failed: %s  (%s:%s:%d)", coll_path, __FILE__, __func__, __LINE__);
+    }
+  }
+  ptimes[2].end = MPI_Wtime();
+
+  /* Read phase */
+  start_io_phase();
+  for (w = first_block; w >= 0 && w <= last_block; w++) {
+    b = (wstart[w] > begin) ? wstart[w] : begin;
+    e = (wstart[w + 1] < end) ? wstart[w + 1] : end;
+    while (b < e) {
+      n = e - b;
+      if (n > GIO_MAX_IO_COUNT) n = GIO_MAX_IO_COUNT;
+      rc = MPI_File_read_at(fhs[wgroup[w] - first_file], foffset[w] + (b - wstart[w]),
+			    rbuf + (b - begin), (int)n, MPI_BYTE, MPI_STATUS_IGNORE);
+      if (rc != MPI_SUCCESS) {
+	gio_err("MPI_File_read_at failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+      }
+      b += n;
+    }
+  }
+  end_io_phase();
+
+  ptimes[5].start = MPI_Wtime();
+  for (g = first_file; g <= last_file; g++) {
+    MPI_File_close(&fhs[g - first_file]);
+  }
+  ptimes[5].end = MPI_Wtime();
+
+  /* Redistribution phase */
+  MPI_Barrier(gio_comm);
+  redist_start = MPI_Wtime();
+  MPI_Alltoallv(rbuf, sendcounts, sdispls, MPI_INT,
+		obuf, recvcounts, rdispls, MPI_INT, gio_comm);
+  redist_end = MPI_Wtime();
+
+  /* Parallel verification of the owned writer blocks */
+  for (w = own_first; w >= 0 && w <= own_last; w++) {
+    int *data = (int*)(obuf + (wstart[w] - own_begin));
+    for (i = 0; i < wsize[w] / sizeof(int); i++) {
+      if (data[i] != wvalue[w]) {
+	gio_err("data of writer %d is not validated at index %d. Value:%d is expected, but is %d (%s:%s:%d)",
+		w, i, wvalue[w], data[i], __FILE__, __func__, __LINE__);
+      }
+    }
+  }
+  verify_end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  print_results();
+  print_bandwidth((double)total);
+
+  local[0] = redist_end - redist_start;
+  local[1] = verify_end - redist_end;
+  MPI_Reduce(local, global, 2, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+  total_bytes = (double)total;
+  if (myrank == 0) {
+    gio_print("redistribution time : %f", global[0]);
+    gio_print("redistribution bw   : %f MB/s", total_bytes / global[0] / 1e6);
+    gio_print("verification time   : %f", global[1]);
+  }
+
+  MPI_Info_free(&info);
+  gio_free(fhs);
+  gio_free(sendcounts);
+  gio_free(sdispls);
+  gio_free(recvcounts);
+  gio_free(rdispls);
+  gio_free(rbuf);
+  gio_free(obuf);
+  gio_free(wsize);
+  gio_free(wstart);
+  gio_free(foffset);
+  gio_free(wgroup);
+  gio_free(wvalue);
+  gio_free(owner);
+  return;
+}
+
+/* Record header in zw files, followed by stored_len bytes */
+struct z_header {
+  uint32_t raw_len;
+  uint32_t stored_len;
+  uint32_t codec;
+  uint32_t reserved;
+};
+
+struct z_file {
+  const char *path;
+  int fd;
+};
+
+int z_write_stage(void *arg, struct gio_pipe_slot *slot)
+{
+  struct z_file *f = (struct z_file*)arg;
+  gio_write(f->path, f->fd, slot->buf, slot->len);
+  return 1;
+}
+
+int z_read_stage(void *arg, struct gio_pipe_slot *slot)
+{
+  struct z_file *f = (struct z_file*)arg;
+  struct z_header *h = (struct z_header*)slot->buf;
+  ssize_t n;
+
+  n = gio_read(f->path, f->fd, h, sizeof(*h));
+  if (n == 0) return 0;
+  if (n != sizeof(*h) || h->stored_len > slot->size - sizeof(*h)) {
+    gio_err("Corrupted record in %s (%s:%s:%d)", f->path, __FILE__, __func__, __LINE__);
+  }
+  n = gio_read(f->path, f->fd, slot->buf + sizeof(*h), h->stored_len);
+  if (n != h->stored_len) {
+    gio_err("Truncated record in %s (%s:%s:%d)", f->path, __FILE__, __func__, __LINE__);
+  }
+  slot->len = sizeof(*h) + n;
+  return 1;
+}
+
+/* Per-rank file of pipe_chunk records. On write the calling thread
+   compresses chunk i+1 while an I/O thread writes chunk i; on read the
+   I/O thread reads ahead while the calling thread decompresses and
+   verifies. Data comes from gio_codec_fill() with -x compressibility. */
+void do_compressed_io(int is_write)
+{
+  struct gio_pipe *pipe;
+  struct gio_pipe_slot *slot;
+  struct z_header *h;
+  struct z_file zf;
+  char mypath[PATH_LEN], mydir[PATH_LEN];
+  char *data, *chunk;
+  size_t off, len, n;
+  double codec_time, busy_time, t;
+  double local[4], global[4];
+  int codec_id;
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+  codec_id = gio_codec_id(codec);
+  get_shard_dir(mydir, myrank);
+  check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.z.%d", mydir, myrank));
+  data = (char*)gio_malloc(data_size);
+  gio_codec_fill(data, data_size, 0, compress_ratio, myrank);
+  chunk = (char*)gio_malloc(pipe_chunk);
+  codec_time = 0;
+  local[0] = local[1] = 0;
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  /* Open the file */
+  ptimes[2].start = MPI_Wtime();
+  zf.path = mypath;
+  zf.fd = open_rank_file(mypath, is_write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY);
+  ptimes[2].end = MPI_Wtime();
+
+  start_io_phase();
+  if (is_write) {
+    pipe = gio_pipe_create(GIO_PIPE_DEPTH, sizeof(struct z_header) + gio_codec_bound(codec_id, pipe_chunk),
+			   1, z_write_stage, &zf);
+    for (off = 0; off < data_size; off += len) {
+      len = (data_size - off < pipe_chunk) ? data_size - off : pipe_chunk;
+      slot = gio_pipe_acquire(pipe);
+      h = (struct z_header*)slot->buf;
+      t = MPI_Wtime();
+      n = gio_codec_compress(codec_id, data + off, len, slot->buf + sizeof(*h), slot->size - sizeof(*h));
+      if (n == 0) {
+	/* Store chunks that do not shrink */
+	memcpy(slot->buf + sizeof(*h), data + off, len);
+	n = len;
+	h->codec = GIO_CODEC_NONE;
+      } else {
+	h->codec = codec_id;
+      }
+      codec_time += MPI_Wtime() - t;
+      h->raw_len = len;
+      h->stored_len = n;
+      h->reserved = 0;
+      slot->len = sizeof(*h) + n;
+      local[0] += len;
+      local[1] += n;
+      gio_pipe_release(pipe, slot);
+    }
+  } else {
+    pipe = gio_pipe_create(GIO_PIPE_DEPTH, sizeof(struct z_header) + gio_codec_bound(GIO_CODEC_ZLIB, pipe_chunk)
+			   + gio_codec_bound(GIO_CODEC_LZ, pipe_chunk), 0, z_read_stage, &zf);
+    off = 0;
+    while ((slot = gio_pipe_acquire(pipe)) != NULL) {
+      h = (struct z_header*)slot->buf;
+      if (h->raw_len > pipe_chunk || off + h->raw_len > data_size) {
+	gio_err("Record of %u bytes at offset %lu does not match -f/-c (%s:%s:%d)",
+		h->raw_len, off, __FILE__, __func__, __LINE__);
+      }
+      t = MPI_Wtime();
+      n = gio_codec_decompress(h->codec, slot->buf + sizeof(*h), h->stored_len, chunk, h->raw_len);
+      codec_time += MPI_Wtime() - t;
+      if (n != h->raw_len || memcmp(chunk, data + off, n) != 0) {
+	gio_err("data is not validated in the chunk at offset %lu (%s:%s:%d)",
+		off, __FILE__, __func__, __LINE__);
+      }
+      off += n;
+      local[0] += n;
+      local[1] += h->stored_len;
+      gio_pipe_release(pipe, slot);
+    }
+    if (off != data_size) {
+      gio_err("Read %lu bytes, but %lu bytes are expected (%s:%s:%d)", off, data_size, __FILE__, __func__, __LINE__);
+    }
+  }
+  busy_time = gio_pipe_destroy(pipe);
+  end_io_phase();
+
+  /* Close Files */
+  ptimes[5].start = MPI_Wtime();
+  if (is_write) {
+    gio_close(mypath, zf.fd);
+  } else {
+    close(zf.fd);
+  }
+  ptimes[5].end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  print_results();
+  print_bandwidth(get_total_data_size());
+
+  local[2] = codec_time;
+  local[3] = busy_time;
+  MPI_Reduce(local, global, 2, MPI_DOUBLE, MPI_SUM, 0, gio_comm);
+  MPI_Reduce(&local[2], &global[2], 2, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+  if (myrank == 0) {
+    gio_print("physical bytes      : %.0f", global[1]);
+    gio_print("compression ratio   : %f", global[0] / global[1]);
+    gio_print("effective bandwidth : %f MB/s", last_io_bandwidth / 1e6);
+    gio_print("physical bandwidth  : %f MB/s", last_io_bandwidth * global[1] / global[0] / 1e6);
+    gio_print("codec time (max)    : %f", global[2]);
+    gio_print("I/O thread busy(max): %f", global[3]);
+  }
+
+  gio_free(chunk);
+  gio_free(data);
+  return;
+}
+
+/* A block handed to the I/O thread of kw/kr; the data is not copied */
+struct k_block {
+  char   *addr;
+  size_t len;
+  off_t  offset;
+};
+
+struct k_file {
+  const char *path;
+  int    fd;
+  char   *data;
+  size_t size;
+};
+
+int k_write_stage(void *arg, struct gio_pipe_slot *slot)
+{
+  struct k_file *f = (struct k_file*)arg;
+  struct k_block *b = (struct k_block*)slot->buf;
+  gio_pwrite(f->path, f->fd, b->addr, b->len, b->offset);
+  return 1;
+}
+
+int k_read_stage(void *arg, struct gio_pipe_slot *slot)
+{
+  struct k_file *f = (struct k_file*)arg;
+  struct k_block *b = (struct k_block*)slot->buf;
+
+  b->offset = (off_t)slot->seq * pipe_chunk;
+  if (b->offset >= f->size) return 0;
+  b->len = (f->size - b->offset < pipe_chunk) ? f->size - b->offset : pipe_chunk;
+  b->addr = f->data + b->offset;
+  if (gio_pread(f->path, f->fd, b->addr, b->len, b->offset) != b->len) {
+    gio_err("Short read of %s at offset %ld (%s:%s:%d)", f->path, b->offset, __FILE__, __func__, __LINE__);
+  }
+  return 1;
+}
+
+void check_block_crc(uint32_t *crcs, long block, const char *addr, size_t len)
+{
+  uint32_t crc = gio_crc32c(0, addr, len);
+  if (crc != crcs[block]) {
+    gio_err("Checksum mismatch in block %ld: %08x is expected, but is %08x (%s:%s:%d)",
+	    block, crcs[block], crc, __FILE__, __func__, __LINE__);
+  }
+  return;
+}
+
+/* End-to-end integrity: CRC32C of every pipe_chunk block is computed
+   while the block is in flight and stored in a sidecar file (<file>.crc),
+   and checked on read. With posix, an I/O thread does pwrite/pread of
+   block i while the caller checksums it (write) or the previous block
+   (read); with mpiio, GIO_PIPE_DEPTH non-blocking transfers are kept in
+   flight on the pw file layout, in gio-file.kcoll.* files of their own. */
+void do_checksummed_io(int is_write)
+{
+  MPI_Comm sub_comm = MPI_COMM_NULL;
+  MPI_File fh = MPI_FILE_NULL, crc_fh;
+  MPI_Info info = MPI_INFO_NULL;
+  MPI_Request reqs[GIO_PIPE_DEPTH];
+  MPI_Offset disp = 0, first_block = 0;
+  struct gio_pipe *pipe;
+  struct gio_pipe_slot *slot;
+  struct k_block *b;
+  struct k_file kf;
+  char mypath[PATH_LEN], mydir[PATH_LEN], crc_path[PATH_LEN];
+  char *data;
+  uint32_t *crcs;
+  long nblocks, i, j;
+  size_t off, len;
+  double crc_time, stage_time, t;
+  double local[2], global[2];
+  int use_mpiio, sub_comm_color, crc_fd, rc;
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+  use_mpiio = (strcmp(io_backend, "mpiio") == 0);
+  if (!use_mpiio && strcmp(io_backend, "posix") != 0) {
+    gio_err("Unknown I/O backend: %s (%s:%s:%d)", io_backend, __FILE__, __func__, __LINE__);
+  }
+  nblocks = (data_size + pipe_chunk - 1) / pipe_chunk;
+  crcs = (uint32_t*)gio_malloc(sizeof(uint32_t) * (nblocks > 0 ? nblocks : 1));
+  data = (char*)create_io_data(is_write ? myrank : -1);
+  if (use_mpiio) {
+    if (m_size == 0) m_size = 1;
+    sub_comm_color = get_sub_collective_io_comm(&sub_comm);
+    check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.kcoll.%d.%d", target_path, sub_comm_color, m_size));
+    disp = get_comm_offset(sub_comm);
+    MPI_Exscan(&nblocks, &first_block, 1, MPI_LONG, MPI_SUM, sub_comm);
+    if (disp == 0) first_block = 0;
+    MPI_Info_create(&info);
+    gio_hints_apply(info);
+  } else {
+    get_shard_dir(mydir, myrank);
+    check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.crc.%d", mydir, myrank));
+  }
+  check_path(crc_path, snprintf(crc_path, PATH_LEN, "%s.crc", mypath));
+  crc_time = stage_time = 0;
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  /* Open the files; a reader loads the checksums up front */
+  ptimes[2].start = MPI_Wtime();
+  if (use_mpiio) {
+    rc = MPI_File_open(sub_comm, mypath, is_write ? MPI_MODE_WRONLY | MPI_MODE_CREATE : MPI_MODE_RDONLY,
+		       info, &fh);
+    if (rc != MPI_SUCCESS) {
+      gio_err("MPI_File_open failed: %s  (%s:%s:%d)", mypath, __FILE__, __func__, __LINE__);
+    }
+    if (!is_write) {
+      rc = MPI_File_open(sub_comm, crc_path, MPI_MODE_RDONLY, info, &crc_fh);
+      if (rc != MPI_SUCCESS) {
+	gio_err("MPI_File_open failed: %s  (%s:%s:%d)", crc_path, __FILE__, __func__, __LINE__);
+      }
+      MPI_File_read_at_all(crc_fh, first_block * sizeof(uint32_t), crcs, nblocks,
+			   MPI_UINT32_T, MPI_STATUS_IGNORE);
+      MPI_File_close(&crc_fh);
+    }
+  } else {
+    kf.path = mypath;
+    kf.fd = open_rank_file(mypath, is_write ? O_WRONLY | O_CREAT : O_RDONLY);
+    kf.data = data;
+    kf.size = data_size;
+    if (!is_write) {
+      crc_fd = gio_open(crc_path, O_RDONLY, 0);
+      if (gio_read(crc_path, crc_fd, crcs, sizeof(uint32_t) * nblocks) != sizeof(uint32_t) * nblocks) {
+	gio_err("Checksum file %s is too short (%s:%s:%d)", crc_path, __FILE__, __func__, __LINE__);
+      }
+      close(crc_fd);
+    }
+  }
+  ptimes[2].end = MPI_Wtime();
+
+  start_io_phase();
+  if (use_mpiio) {
+    for (i = 0; i < nblocks + GIO_PIPE_DEPTH; i++) {
+      /* Complete block j, issued GIO_PIPE_DEPTH blocks ago */
+      j = i - GIO_PIPE_DEPTH;
+      if (j >= 0 && j < nblocks) {
+	t = MPI_Wtime();
+	MPI_Wait(&reqs[j % GIO_PIPE_DEPTH], MPI_STATUS_IGNORE);
+	stage_time += MPI_Wtime() - t;
+	if (!is_write) {
+	  off = j * pipe_chunk;
+	  len = (data_size - off < pipe_chunk) ? data_size - off : pipe_chunk;
+	  t = MPI_Wtime();
+	  check_block_crc(crcs, j, data + off, len);
+	  crc_time += MPI_Wtime() - t;
+	}
+      }
+      if (i < nblocks) {
+	off = i * pipe_chunk;
+	len = (data_size - off < pipe_chunk) ? data_size - off : pipe_chunk;
+	if (is_write) {
+	  rc = MPI_File_iwrite_at(fh, disp + off, data + off, (int)len, MPI_BYTE, &reqs[i % GIO_PIPE_DEPTH]);
+	} else {
+	  rc = MPI_File_iread_at(fh, disp + off, data + off, (int)len, MPI_BYTE, &reqs[i % GIO_PIPE_DEPTH]);
+	}
+	if (rc != MPI_SUCCESS) {
+	  gio_err("Non-blocking MPI-IO failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+	}
+	if (is_write) {
+	  t = MPI_Wtime();
+	  crcs[i] = gio_crc32c(0, data + off, len);
+	  crc_time += MPI_Wtime() - t;
+	}
+      }
+    }
+  } else if (is_write) {
+    pipe = gio_pipe_create(GIO_PIPE_DEPTH, sizeof(struct k_block), 1, k_write_stage, &kf);
+    for (i = 0; i < nblocks; i++) {
+      slot = gio_pipe_acquire(pipe);
+      b = (struct k_block*)slot->buf;
+      b->offset = (off_t)i * pipe_chunk;
+      b->len = (data_size - b->offset < pipe_chunk) ? data_size - b->offset : pipe_chunk;
+      b->addr = data + b->offset;
+      gio_pipe_release(pipe, slot);
+      t = MPI_Wtime();
+      crcs[i] = gio_crc32c(0, b->addr, b->len);
+      crc_time += MPI_Wtime() - t;
+    }
+    stage_time = gio_pipe_destroy(pipe);
+  } else {
+    pipe = gio_pipe_create(GIO_PIPE_DEPTH, sizeof(struct k_block), 0, k_read_stage, &kf);
+    for (i = 0; (slot = gio_pipe_acquire(pipe)) != NULL; i++) {
+      b = (struct k_block*)slot->buf;
+      t = MPI_Wtime();
+      check_block_crc(crcs, i, b->addr, b->len);
+      crc_time += MPI_Wtime() - t;
+      gio_pipe_release(pipe, slot);
+    }
+    stage_time = gio_pipe_destroy(pipe);
+    if (i != nblocks) {
+      gio_err("Read %ld blocks, but %ld blocks are expected (%s:%s:%d)", i, nblocks, __FILE__, __func__, __LINE__);
+    }
+  }
+
+  /* The sidecar */
+  if (is_write) {
+    if (use_mpiio) {
+      rc = MPI_File_open(sub_comm, crc_path, MPI_MODE_WRONLY | MPI_MODE_CREATE, info, &crc_fh);
+      if (rc != MPI_SUCCESS) {
+	gio_err("MPI_File_open failed: %s  (%s:%s:%d)", crc_path, __FILE__, __func__, __LINE__);
+      }
+      MPI_File_write_at_all(crc_fh, first_block * sizeof(uint32_t), crcs, nblocks,
+			    MPI_UINT32_T, MPI_STATUS_IGNORE);
+      MPI_File_close(&crc_fh);
+    } else {
+      crc_fd = gio_open(crc_path, O_WRONLY | O_CREAT | O_TRUNC, 0);
+      gio_write(crc_path, crc_fd, crcs, sizeof(uint32_t) * nblocks);
+      gio_close(crc_path, crc_fd);
+    }
+  }
+  end_io_phase();
+
+  /* Close Files */
+  ptimes[5].start = MPI_Wtime();
+  if (use_mpiio) {
+    MPI_File_close(&fh);
+    MPI_Info_free(&info);
+    MPI_Comm_free(&sub_comm);
+  } else if (is_write) {
+    gio_close(mypath, kf.fd);
+  } else {
+    close(kf.fd);
+  }
+  ptimes[5].end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  print_results();
+  print_bandwidth(get_total_data_size());
+
+  local[0] = crc_time;
+  local[1] = stage_time;
+  MPI_Reduce(local, global, 2, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+  if (myrank == 0) {
+    gio_print("crc32c              : %s", gio_crc32c_impl());
+    gio_print("checksum time (max) : %f", global[0]);
+    gio_print("checksum rate       : %f MB/s per rank", data_size / global[0] / 1e6);
+    gio_print("%s: %f", use_mpiio ? "MPI_Wait time (max) " : "I/O thread busy(max)", global[1]);
+  }
+
+  free_io_data((int*)data);
+  gio_free(crcs);
+  return;
+}
+
+struct copy_file {
+  char   src[PATH_LEN];
+  char   dst[PATH_LEN];
+  long   size;
+  long   first_chunk;
+};
+
+/* Append src to the files of cp, copied to target_path/name. A source
+   that is its own destination (e.g. -u and -d are the same directory)
+   is an error: O_TRUNC on the destination would destroy it. */
+void add_copy_file(struct copy_file **files, int *count, int *cap,
+		   const char *src, const char *name, const struct stat *src_st)
+{
+  struct copy_file *f;
+  struct stat st;
+
+  if (*count == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    f = (struct copy_file*)gio_malloc(sizeof(struct copy_file) * *cap);
+    if (*count > 0) {
+      memcpy(f, *files, sizeof(struct copy_file) * *count);
+      gio_free(*files);
+    }
+    *files = f;
+  }
+  f = &(*files)[*count];
+  check_path(f->src, snprintf(f->src, PATH_LEN, "%s", src));
+  check_path(f->dst, snprintf(f->dst, PATH_LEN, "%s/%s", target_path, name));
+  if (stat(f->dst, &st) == 0 && st.st_dev == src_st->st_dev && st.st_ino == src_st->st_ino) {
+    gio_err("Source %s and destination %s are the same file (%s:%s:%d)",
+	    f->src, f->dst, __FILE__, __func__, __LINE__);
+  }
+  f->size = src_st->st_size;
+  (*count)++;
+  return;
+}
+
+/* Source files of cp, collected by rank 0: every regular file of a
+   directory, or a comma separated list of files */
+int list_copy_files(struct copy_file **files)
+{
+  struct copy_file *f = NULL;
+  struct stat st;
+  struct dirent *ent;
+  DIR *dir;
+  char path[PATH_LEN];
+  char *copy, *tok, *save, *base;
+  int count = 0, cap = 0;
+
+  if (stat(source_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    if ((dir = opendir(source_path)) == NULL) {
+      gio_err("opendir(%s) failed: %m (%s:%s:%d)", source_path, __FILE__, __func__, __LINE__);
+    }
+    while ((ent = readdir(dir)) != NULL) {
+      check_path(path, snprintf(path, PATH_LEN, "%s/%s", source_path, ent->d_name));
+      if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+      add_copy_file(&f, &count, &cap, path, ent->d_name, &st);
+    }
+    closedir(dir);
+  } else {
+    copy = strdup(source_path);
+    for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+      if (stat(tok, &st) != 0 || !S_ISREG(st.st_mode)) {
+	gio_err("%s is not a regular file (%s:%s:%d)", tok, __FILE__, __func__, __LINE__);
+      }
+      base = strrchr(tok, '/');
+      add_copy_file(&f, &count, &cap, tok, base ? base + 1 : tok, &st);
+    }
+    free(copy);
+  }
+  *files = f;
+  return count;
+}
+
+/* Parallel data mover: the files are cut into pipe_chunk chunks, each
+   rank starts with a balanced range of chunks, and a rank that runs out
+   steals chunks from the others through atomic counters in an RMA
+   window. Chunks are copied in the kernel with copy_file_range or
+   splice when possible, through a buffer otherwise. */
+void do_copy()
+{
+  MPI_Win win;
+  struct copy_file *files = NULL;
+  int *src_fds, *dst_fds;
+  long *next;
+  long nchunks, begin, end, chunk, one = 1;
+  long stolen = 0;
+  double bytes[3] = {0, 0, 0}, total[3];
+  double local_stolen, total_stolen;
+  char *buf;
+  int nfiles, f, victim, tries, method, start_method, fd;
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+  if (strcmp(copy_method, "copy_file_range") == 0) {
+    start_method = GIO_COPY_CFR;
+  } else if (strcmp(copy_method, "splice") == 0) {
+    start_method = GIO_COPY_SPLICE;
+  } else if (strcmp(copy_method, "rw") == 0) {
+    start_method = GIO_COPY_RW;
+  } else {
+    gio_err("Unknown copy method: %s (%s:%s:%d)", copy_method, __FILE__, __func__, __LINE__);
+    return;
+  }
+
+  if (myrank == 0) {
+    nfiles = list_copy_files(&files);
+  }
+  MPI_Bcast(&nfiles, 1, MPI_INT, 0, gio_comm);
+  if (myrank != 0) {
+    files = (struct copy_file*)gio_malloc(sizeof(struct copy_file) * (nfiles > 0 ? nfiles : 1));
+  }
+  MPI_Bcast(files, sizeof(struct copy_file) * nfiles, MPI_BYTE, 0, gio_comm);
+
+  /* Every file has at least one chunk, so that empty files are created */
+  nchunks = 0;
+  for (f = 0; f < nfiles; f++) {
+    files[f].first_chunk = nchunks;
+    nchunks += (files[f].size > 0) ? (files[f].size + pipe_chunk - 1) / pipe_chunk : 1;
+  }
+
+  /* next[0]: next unclaimed chunk of this rank's range, next[1]: its end */
+  MPI_Win_allocate(2 * sizeof(long), sizeof(long), MPI_INFO_NULL, gio_comm, &next, &win);
+  next[0] = nchunks * myrank / world_comm_size;
+  next[1] = nchunks * (myrank + 1) / world_comm_size;
+  src_fds = (int*)gio_malloc(sizeof(int) * (nfiles > 0 ? nfiles : 1));
+  dst_fds = (int*)gio_malloc(sizeof(int) * (nfiles > 0 ? nfiles : 1));
+  for (f = 0; f < nfiles; f++) {
+    src_fds[f] = dst_fds[f] = -1;
+  }
+  buf = (char*)gio_malloc(pipe_chunk);
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  /* Create the destination files at their final size */
+  ptimes[2].start = MPI_Wtime();
+  for (f = myrank; f < nfiles; f += world_comm_size) {
+    fd = gio_open(files[f].dst, O_WRONLY | O_CREAT | O_TRUNC, 0);
+    if (ftruncate(fd, files[f].size) != 0) {
+      gio_err("ftruncate(%s) failed: %m (%s:%s:%d)", files[f].dst, __FILE__, __func__, __LINE__);
+    }
+    close(fd);
+  }
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+  MPI_Barrier(gio_comm);
+  ptimes[2].end = MPI_Wtime();
+
+  start_io_phase();
+  victim = myrank;
+  tries = 0;
+  f = 0;
+  while (tries < world_comm_size) {
+    MPI_Fetch_and_op(&one, &chunk, MPI_LONG, victim, 0, MPI_SUM, win);
+    MPI_Get(&end, 1, MPI_LONG, victim, 1, 1, MPI_LONG, win);
+    MPI_Win_flush(victim, win);
+    if (chunk >= end) {
+      /* Range exhausted: try the next rank */
+      victim = (victim + 1) % world_comm_size;
+      tries++;
+      continue;
+    }
+    if (victim != myrank) stolen++;
+
+    while (f + 1 < nfiles && files[f + 1].first_chunk <= chunk) f++;
+    while (f > 0 && files[f].first_chunk > chunk) f--;
+    if (src_fds[f] < 0) {
+      src_fds[f] = gio_open(files[f].src, O_RDONLY, 0);
+      dst_fds[f] = gio_open(files[f].dst, O_WRONLY, 0);
+    }
+    begin = (chunk - files[f].first_chunk) * pipe_chunk;
+    if (begin < files[f].size) {
+      size_t len = (files[f].size - begin < pipe_chunk) ? files[f].size - begin : pipe_chunk;
+      method = start_method;
+      if (gio_copy_range(files[f].src, src_fds[f], files[f].dst, dst_fds[f],
+			 begin, len, &method, buf, pipe_chunk) != len) {
+	gio_err("Short copy of %s at offset %ld (%s:%s:%d)", files[f].src, begin, __FILE__, __func__, __LINE__);
+      }
+      bytes[method] += len;
+      /* Do not retry methods that failed on this file system */
+      if (method > start_method) start_method = method;
+    }
+  }
+  end_io_phase();
+
+  ptimes[5].start = MPI_Wtime();
+  for (f = 0; f < nfiles; f++) {
+    if (src_fds[f] >= 0) {
+      close(src_fds[f]);
+      gio_close(files[f].dst, dst_fds[f]);
+    }
+  }
+  MPI_Win_unlock_all(win);
+  ptimes[5].end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  MPI_Reduce(bytes, total, 3, MPI_DOUBLE, MPI_SUM, 0, gio_comm);
+  print_results();
+  print_bandwidth(total[0] + total[1] + total[2]);
+
+  local_stolen = stolen;
+  MPI_Reduce(&local_stolen, &total_stolen, 1, MPI_DOUBLE, MPI_SUM, 0, gio_comm);
+  if (myrank == 0) {
+    gio_print("files               : %d", nfiles);
+    gio_print("chunks              : %ld (%.0f stolen)", nchunks, total_stolen);
+    gio_print("copy_file_range     : %.0f bytes", total[GIO_COPY_CFR]);
+    gio_print("splice              : %.0f bytes", total[GIO_COPY_SPLICE]);
+    gio_print("read/write          : %.0f bytes", total[GIO_COPY_RW]);
+    gio_print("copy throughput     : %f MB/s", last_io_bandwidth / 1e6);
+  }
+
+  MPI_Win_free(&win);
+  gio_free(buf);
+  gio_free(src_fds);
+  gio_free(dst_fds);
+  if (files) gio_free(files);
+  return;
+}
+
+void do_sequential_write()
+{
+  int fd;
+  int *buf;
+  size_t wsize;
+  char mypath[PATH_LEN];
+
+  if (myrank == 0) {
+    gio_dbg("Write: scale: %s, size: %lu", scale, data_size);
+  }
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+  get_rank_path(mypath);
+  buf = create_io_data(myrank);
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  ptimes[2].start = MPI_Wtime();
+  fd = open_rank_file(mypath, O_WRONLY | O_CREAT);
+  if (fd < 0) {
+    gio_err("File open failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  ptimes[2].end = MPI_Wtime();
+
+  start_io_phase();
+  wsize = gio_write(mypath, fd, buf, data_size);
+  if (wsize != data_size) {
+    gio_err("Input write size is %lu, but only %lu bytes are written (%s:%s:%d)", data_size, wsize, __FILE__, __func__, __LINE__);
+  }
+  end_io_phase();
+
+  ptimes[5].start = MPI_Wtime();
+  gio_close(mypath, fd);
+  ptimes[5].end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  free_io_data(buf);
+  print_results();
+  print_bandwidth(get_total_data_size());
+  return;
+}
+
+/* Paths are built with snprintf() into PATH_LEN buffers; len is its
+   return value. A path that does not fit is an error, not truncated. */
+void check_path(const char *path, int len)
+{
+  if (len < 0 || len >= PATH_LEN) {
+    gio_err("Path is longer than %d bytes: %s... (%s:%s:%d)", PATH_LEN - 1, path, __FILE__, __func__, __LINE__);
+  }
+  return;
+}
+
+void get_rank_path(char *mypath)
+{
+  char mydir[PATH_LEN];
+
+  get_shard_dir(mydir, myrank);
+  check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.%d", mydir, myrank));
+  return;
+}
+
+/* Directory of the per-rank files of rank: target_path itself, or with
+   -F one of shard_count gio-dir.<shard> subdirectories so that creates
+   are spread over several directory locks. Ranks are assigned modulo
+   shard_count, so consecutive ranks (those of one node) go to different
+   shards and every shard holds the same number of files to within one. */
+void get_shard_dir(char *mydir, int rank)
+{
+  if (shard_count == 0) {
+    check_path(mydir, snprintf(mydir, PATH_LEN, "%s", target_path));
+  } else {
+    check_path(mydir, snprintf(mydir, PATH_LEN, "%s/gio-dir.%d", target_path, rank % shard_count));
+  }
+  return;
+}
+
+/* Experiments that write (read) one file per rank, the ones -F applies to */
+int use_rank_files()
+{
+  return strcmp(expr, "sw") == 0 || strcmp(expr, "sr") == 0 ||
+    strcmp(expr, "tw") == 0 || strcmp(expr, "tr") == 0 ||
+    strcmp(expr, "zw") == 0 || strcmp(expr, "zr") == 0 ||
+    ((strcmp(expr, "kw") == 0 || strcmp(expr, "kr") == 0) && strcmp(io_backend, "posix") == 0);
+}
+
+/* Create the shard directories, spread over the ranks */
+void make_shard_dirs()
+{
+  char mydir[PATH_LEN];
+  double start, elapsed;
+  int shard;
+
+  start = MPI_Wtime();
+  for (shard = myrank; shard < shard_count; shard += world_comm_size) {
+    check_path(mydir, snprintf(mydir, PATH_LEN, "%s/gio-dir.%d", target_path, shard));
+    if (mkdir(mydir, S_IRWXU) != 0 && errno != EEXIST) {
+      gio_err("mkdir(%s) failed: errno=%d %m (%s:%s:%d)", mydir, errno, __FILE__, __func__, __LINE__);
+    }
+  }
+  MPI_Barrier(gio_comm);
+  elapsed = MPI_Wtime() - start;
+  if (myrank == 0) {
+    gio_print("shard mkdir time    : %f", elapsed);
+  }
+  return;
+}
+
+/* gio_open() of a per-rank file under open admission (-O). token: rank r
+   opens after rank r - open_window has, so open_window chains of opens
+   run at a time; window: ranks open in waves of open_window separated
+   by barriers. Both bound the create rate seen by the metadata server.
+   window is collective over gio_comm. */
+int open_rank_file(const char *path, int flags)
+{
+  int fd = -1;
+  int wave;
+
+  if (strcmp(open_admission, "token") == 0) {
+    if (myrank >= open_window) {
+      MPI_Recv(NULL, 0, MPI_BYTE, myrank - open_window, GIO_OPEN_TOKEN_TAG, gio_comm, MPI_STATUS_IGNORE);
+    }
+    fd = gio_open(path, flags, 0);
+    if (myrank + open_window < world_comm_size) {
+      MPI_Send(NULL, 0, MPI_BYTE, myrank + open_window, GIO_OPEN_TOKEN_TAG, gio_comm);
+    }
+  } else if (strcmp(open_admission, "window") == 0) {
+    for (wave = 0; wave * open_window < world_comm_size; wave++) {
+      if (wave == myrank / open_window) {
+	fd = gio_open(path, flags, 0);
+      }
+      MPI_Barrier(gio_comm);
+    }
+  } else if (strcmp(open_admission, "none") == 0) {
+    fd = gio_open(path, flags, 0);
+  } else {
+    gio_err("Unknown open admission: %s (%s:%s:%d)", open_admission, __FILE__, __func__, __LINE__);
+  }
+  return fd;
+}
+
+void get_coll_io_path(char *mypath, int comm_color)
+{
+  check_path(mypath, snprintf(mypath, PATH_LEN, "%s/gio-file.coll.%d.%d", target_path, comm_color, m_size));
+  return;
+}
+
+
+
+/* One sequential pass over the file in pipe_chunk blocks, validating
+   each block as it is consumed. mode selects how data is prefetched:
+   none (one blocking read at a time), fadvise (POSIX_FADV_WILLNEED on a
+   sliding window), readahead (readahead(2) on a sliding window) or
+   thread (a helper thread keeps prefetch_window bytes read ahead). */
+double sequential_read_pass(const char *path, int fd, char *data, const char *mode)
+{
+  struct gio_pipe *pipe;
+  struct gio_pipe_slot *slot;
+  struct k_block *b;
+  struct k_file kf;
+  off_t off, advised;
+  size_t len;
+  double start;
+  int depth;
+
+  start = MPI_Wtime();
+  if (strcmp(mode, "thread") == 0) {
+    kf.path = path;
+    kf.fd = fd;
+    kf.data = data;
+    kf.size = data_size;
+    depth = prefetch_window / pipe_chunk;
+    if (depth < 1) depth = 1;
+    pipe = gio_pipe_create(depth, sizeof(struct k_block), 0, k_read_stage, &kf);
+    while ((slot = gio_pipe_acquire(pipe)) != NULL) {
+      b = (struct k_block*)slot->buf;
+      validate_io_range((int*)b->addr, b->len, myrank);
+      gio_pipe_release(pipe, slot);
+    }
+    gio_pipe_destroy(pipe);
+    return MPI_Wtime() - start;
+  }
+
+  advised = 0;
+  if (strcmp(mode, "fadvise") == 0 || strcmp(mode, "readahead") == 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  } else if (strcmp(mode, "none") != 0) {
+    gio_err("Unknown prefetch mode: %s (%s:%s:%d)", mode, __FILE__, __func__, __LINE__);
+  }
+  for (off = 0; off < data_size; off += len) {
+    len = (data_size - off < pipe_chunk) ? data_size - off : pipe_chunk;
+    /* Keep the window ahead of the current block */
+    while (strcmp(mode, "none") != 0 && advised < off + prefetch_window && advised < data_size) {
+      if (strcmp(mode, "fadvise") == 0) {
+	posix_fadvise(fd, advised, pipe_chunk, POSIX_FADV_WILLNEED);
+      } else {
+	readahead(fd, advised, pipe_chunk);
+      }
+      advised += pipe_chunk;
+    }
+    if (gio_pread(path, fd, data + off, len, off) != len) {
+      gio_err("Short read of %s at offset %ld (%s:%s:%d)", path, off, __FILE__, __func__, __LINE__);
+    }
+    validate_io_range((int*)(data + off), len, myrank);
+  }
+  return MPI_Wtime() - start;
+}
+
+/* Read back the sw files. With a prefetch mode (-r), a plain pass is
+   timed first for comparison; the page cache of the file is dropped
+   before each pass. */
+void do_sequential_read()
+{
+  int fd;
+  char *addr;
+  char mypath[PATH_LEN];
+  double plain_time = 0;
+  double local[2], global[2];
+
+  if (myrank == 0) {
+    gio_dbg("Read: scale: %s, size: %lu", scale, data_size);
+  }
+
+  ptimes[0].start = MPI_Wtime();
+  ptimes[1].start = MPI_Wtime();
+  get_rank_path(mypath);
+  addr = (char*)gio_malloc(data_size);  
+  ptimes[1].end = MPI_Wtime();
+
+  MPI_Barrier(gio_comm);
+
+  ptimes[2].start = MPI_Wtime();
+  fd = open_rank_file(mypath, O_RDONLY);
+  if (fd < 0) {
+    gio_err("File open failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  ptimes[2].end = MPI_Wtime();
+
+  if (strcmp(prefetch, "none") != 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    MPI_Barrier(gio_comm);
+    plain_time = sequential_read_pass(mypath, fd, addr, "none");
+  }
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  MPI_Barrier(gio_comm);
+  start_io_phase();
+  sequential_read_pass(mypath, fd, addr, prefetch);
+  end_io_phase();
+
+  ptimes[5].start = MPI_Wtime();
+  close(fd);
+  ptimes[5].end = MPI_Wtime();
+  ptimes[0].end = MPI_Wtime();
+
+  gio_free(addr);
+  print_results();
+  print_bandwidth(get_total_data_size());
+
+  if (strcmp(prefetch, "none") != 0) {
+    double total = get_total_data_size();
+    local[0] = plain_time;
+    local[1] = ptimes[4].end - ptimes[4].start;
+    MPI_Reduce(local, global, 2, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+    if (myrank == 0) {
+      gio_print("plain read bw       : %f MB/s", total / global[0] / 1e6);
+      gio_print("%-9s read bw   : %f MB/s", prefetch, total / global[1] / 1e6);
+      gio_print("speedup             : %f", global[0] / global[1]);
+    }
+  }
+  return;
+}
+
+/* Background load run by a helper thread of every rank during the
+   timed I/O phase. alltoall and neighbor (ring exchange with both
+   neighbours) loop on a duplicate of gio_comm; every round ends with an
+   allreduce of the stop flags, so the load goes on until every rank has
+   finished its I/O and all ranks leave at the same round. membw streams
+   a triad over three arrays. */
+struct noise_thread {
+  pthread_t thread;
+  MPI_Comm  comm;
+  int       started;
+  int       stop;
+  size_t    size;
+  char      *buf[3];
+  double    bytes;   /* moved by this rank */
+  double    elapsed;
+};
+
+/* Load of the running -N pass, NULL on a quiet pass */
+struct noise_thread *active_noise = NULL;
+
+/* Buffers of the load are set up before the pass so that the thread
+   only generates load: three arrays of n->size bytes for membw, send
+   and receive buffers otherwise */
+void noise_alloc(struct noise_thread *n)
+{
+  size_t i, len;
+  double *a;
+
+  if (strcmp(noise, "membw") == 0) {
+    len = (n->size / sizeof(double) > 0 ? n->size / sizeof(double) : 1) * sizeof(double);
+  } else if (strcmp(noise, "alltoall") == 0) {
+    len = (n->size / world_comm_size > 0 ? n->size / world_comm_size : 1) * world_comm_size;
+  } else {
+    len = n->size;
+  }
+  for (i = 0; i < 3; i++) {
+    n->buf[i] = (char*)gio_malloc(len);
+    memset(n->buf[i], 0, len);
+  }
+  if (strcmp(noise, "membw") == 0) {
+    for (a = (double*)n->buf[1]; (char*)a < n->buf[1] + len; a++) *a = 1;
+    for (a = (double*)n->buf[2]; (char*)a < n->buf[2] + len; a++) *a = 2;
+  }
+  return;
+}
+
+void noise_free(struct noise_thread *n)
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    gio_free(n->buf[i]);
+  }
+  return;
+}
+
+void* noise_main(void *arg)
+{
+  struct noise_thread *n = (struct noise_thread*)arg;
+  int rank, size, left, right, stop, all;
+  char *sbuf = n->buf[0], *rbuf = n->buf[1];
+  double *a = (double*)n->buf[0], *b = (double*)n->buf[1], *c = (double*)n->buf[2];
+  size_t i, j, end, count, peer_size;
+  size_t stride = 1 << 16;
+  double start;
+
+  start = MPI_Wtime();
+  if (strcmp(noise, "membw") == 0) {
+    count = n->size / sizeof(double) > 0 ? n->size / sizeof(double) : 1;
+    /* Check the flag every stride so that the load stops with the I/O */
+    for (i = 0; !__atomic_load_n(&n->stop, __ATOMIC_RELAXED); i = (i + stride) % count) {
+      end = (i + stride < count) ? i + stride : count;
+      for (j = i; j < end; j++) {
+	a[j] = b[j] + 3.0 * c[j];
+      }
+      n->bytes += 3.0 * sizeof(double) * (end - i);
+    }
+    n->elapsed = MPI_Wtime() - start;
+    return NULL;
+  }
+
+  MPI_Comm_rank(n->comm, &rank);
+  MPI_Comm_size(n->comm, &size);
+  left = (rank + size - 1) % size;
+  right = (rank + 1) % size;
+  peer_size = n->size / size > 0 ? n->size / size : 1;
+  do {
+    if (strcmp(noise, "alltoall") == 0) {
+      MPI_Alltoall(sbuf, peer_size, MPI_BYTE, rbuf, peer_size, MPI_BYTE, n->comm);
+      n->bytes += (double)peer_size * (size - 1);
+    } else {
+      MPI_Sendrecv(sbuf, n->size, MPI_BYTE, right, 0, rbuf, n->size, MPI_BYTE, left, 0,
+		   n->comm, MPI_STATUS_IGNORE);
+      MPI_Sendrecv(sbuf, n->size, MPI_BYTE, left, 1, rbuf, n->size, MPI_BYTE, right, 1,
+		   n->comm, MPI_STATUS_IGNORE);
+      n->bytes += (size > 1) ? 2.0 * n->size : 0;
+    }
+    stop = __atomic_load_n(&n->stop, __ATOMIC_RELAXED);
+    MPI_Allreduce(&stop, &all, 1, MPI_INT, MPI_MIN, n->comm);
+  } while (!all);
+  n->elapsed = MPI_Wtime() - start;
+  return NULL;
+}
+
+/* Timed I/O phase of an experiment (ptimes[4]); under -N the background
+   load of the pass runs only within it */
+void start_io_phase()
+{
+  if (active_noise != NULL && !active_noise->started) {
+    if (pthread_create(&active_noise->thread, NULL, noise_main, active_noise) != 0) {
+      gio_err("pthread_create failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+    }
+    active_noise->started = 1;
+  }
+  ptimes[4].start = MPI_Wtime();
+  return;
+}
+
+void end_io_phase()
+{
+  ptimes[4].end = MPI_Wtime();
+  if (active_noise != NULL) {
+    __atomic_store_n(&active_noise->stop, 1, __ATOMIC_RELAXED);
+  }
+  return;
+}
+
+/* Run the experiment once to warm up (files exist, caches are in the
+   same state for every pass), then noise_rounds pairs of quiet and
+   loaded passes in alternating order, so that the bandwidth loss is not
+   biased by which pass runs first */
+void do_interference()
+{
+  struct noise_thread n;
+  double bw[2] = {0, 0};
+  double bytes = 0, elapsed = 0, pass_bytes, pass_elapsed;
+  int round, k, loaded, valid = 1;
+
+  if (strcmp(noise, "alltoall") != 0 && strcmp(noise, "neighbor") != 0 && strcmp(noise, "membw") != 0) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+  if (thread_provided < MPI_THREAD_MULTIPLE) {
+    gio_err("MPI_THREAD_MULTIPLE is not provided by this MPI (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("Interference warm-up: no background load");
+  }
+  do_experiment();
+
+  for (round = 0; round < noise_rounds; round++) {
+    for (k = 0; k < 2; k++) {
+      loaded = (round % 2 == 0) ? k : 1 - k;
+      memset(&n, 0, sizeof(n));
+      n.size = noise_size;
+      if (n.size == 0) {
+	n.size = (strcmp(noise, "membw") == 0) ? 64 << 20 : 1 << 20;
+      }
+      if (myrank == 0) {
+	gio_print("===============================================");
+	if (loaded) {
+	  gio_print("Interference round %d: %s background load, %lu bytes per round", round, noise, n.size);
+	} else {
+	  gio_print("Interference round %d: no background load", round);
+	}
+      }
+      if (loaded) {
+	noise_alloc(&n);
+	MPI_Comm_dup(gio_comm, &n.comm);
+	active_noise = &n;
+      }
+      do_experiment();
+      if (loaded) {
+	active_noise = NULL;
+	if (n.started) {
+	  pthread_join(n.thread, NULL);
+	}
+	MPI_Comm_free(&n.comm);
+	noise_free(&n);
+	MPI_Reduce(&n.bytes, &pass_bytes, 1, MPI_DOUBLE, MPI_SUM, 0, gio_comm);
+	MPI_Reduce(&n.elapsed, &pass_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, gio_comm);
+	bytes += pass_bytes;
+	elapsed += pass_elapsed;
+      }
+      if (last_io_bandwidth < 0) valid = 0;
+      bw[loaded] += last_io_bandwidth / noise_rounds;
+    }
+  }
+
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("background load     : %s", noise);
+    gio_print("rounds              : %d", noise_rounds);
+    gio_print("background traffic  : %f MB/s", elapsed > 0 ? bytes / elapsed / 1e6 : 0);
+    if (!valid) {
+      gio_print("bandwidth loss      : - (%s reports no io bandwidth)", expr);
+    } else {
+      gio_print("quiet io bandwidth  : %f MB/s (mean)", bw[0] / 1e6);
+      gio_print("loaded io bandwidth : %f MB/s (mean)", bw[1] / 1e6);
+      gio_print("bandwidth loss      : %f %%", 100.0 * (bw[0] - bw[1]) / bw[0]);
+    }
+  }
+  return;
+}
+
+void do_experiment()
+{
+  data_size = get_local_data_size(myrank, world_comm_size);
+  last_io_bandwidth = -1;
+
+  if (myrank == 0) {
+    int sf = (m_size > 0) ? max_striping_factor / m_size : max_striping_factor;
+    if (sf == 0) sf = 1;
+    gio_print("===============================================");
+    gio_print("Experiment          : %s", expr);
+    gio_print("Scale               : %s", scale);
+    gio_print("local_data_size     : %lu", data_size);
+    if (strcmp(scale, "s") == 0) {
+      gio_print("global_data_size    : %lu", input_data_size);
+      gio_print("block_size          : %lu", block_size);
+    }
+    gio_print("Target path         : %s", target_path);
+    gio_print("# of processes      : %d", world_comm_size);
+    gio_print("# of files          : %d", m_size);
+    gio_print("max_striping_factor : %d", max_striping_factor);
+    gio_print("striping_factor     : %d", sf);
+    gio_print("striping_unit       : %s", striping_unit);
+    gio_hints_print();
+    if (shard_count > 0 && use_rank_files()) {
+      gio_print("directory fan-out   : %d", shard_count);
+    }
+    if (strcmp(open_admission, "none") != 0) {
+      gio_print("open admission      : %s (%d at a time)", open_admission, open_window);
+    }
+    if (strcmp(expr, "nw") == 0) {
+      gio_print("leaders per node    : %d", leaders_per_node);
+    }
+    if (strcmp(expr, "mw") == 0) {
+      gio_print("file count sweep    : %s", m_sweep);
+    }
+    if (strcmp(expr, "rr") == 0) {
+      gio_print("# of writers        : %d", writer_count ? writer_count : world_comm_size);
+    }
+    if (strcmp(expr, "kw") == 0 || strcmp(expr, "kr") == 0) {
+      gio_print("I/O backend         : %s", io_backend);
+      gio_print("checksum block      : %lu", pipe_chunk);
+      gio_print("crc32c              : %s", gio_crc32c_impl());
+    }
+    if (strcmp(expr, "sr") == 0) {
+      gio_print("prefetch            : %s", prefetch);
+      gio_print("prefetch window     : %lu", prefetch_window);
+      gio_print("read block          : %lu", pipe_chunk);
+    }
+    if (strcmp(expr, "cp") == 0) {
+      gio_print("Source path         : %s", source_path);
+      gio_print("copy chunk          : %lu", pipe_chunk);
+      gio_print("copy method         : %s", copy_method);
+    }
+    if (strcmp(expr, "zw") == 0 || strcmp(expr, "zr") == 0) {
+      gio_print("codec               : %s", codec);
+      gio_print("data compressibility: %f", compress_ratio);
+      gio_print("pipeline chunk      : %lu", pipe_chunk);
+    }
+    if (strcmp(expr, "bw") == 0) {
+      gio_print("Staging path        : %s", stage_path);
+      gio_print("drain buffer        : %lu", drain_chunk);
+      gio_print("drain throttle      : %f MB/s", drain_rate);
+    }
+    if (strcmp(expr, "tw") == 0 || strcmp(expr, "tr") == 0) {
+      gio_print("threads per rank    : %d", thread_count);
+      gio_print("I/O backend         : %s", io_backend);
+      gio_print("thread pinning      : %s", thread_pinning);
+      gio_print("thread buffer       : %s", thread_buffer);
+    }
+  }
+  if (shard_count > 0 && use_rank_files()) {
+    make_shard_dirs();
+  }
+  MPI_Barrier(gio_comm);
+  if (strcmp(expr, "sw") == 0) {
+    do_sequential_write();
+  } else if (strcmp(expr, "sr") == 0) {
+    do_sequential_read();
+  } else if (strcmp(expr, "pw") == 0) {
+    do_collective_write();
+  } else if (strcmp(expr, "pr") == 0) {
+    do_collective_read();
+  } else if (strcmp(expr, "nw") == 0) {
+    do_node_aggregated_write();
+  } else if (strcmp(expr, "tw") == 0) {
+    do_threaded_io(1);
+  } else if (strcmp(expr, "tr") == 0) {
+    do_threaded_io(0);
+  } else if (strcmp(expr, "tune") == 0) {
+    do_tune();
+  } else if (strcmp(expr, "mw") == 0) {
+    do_m_sweep();
+  } else if (strcmp(expr, "bw") == 0) {
+    do_staged_write();
+  } else if (strcmp(expr, "rr") == 0) {
+    do_reshape_read();
+  } else if (strcmp(expr, "zw") == 0) {
+    do_compressed_io(1);
+  } else if (strcmp(expr, "zr") == 0) {
+    do_compressed_io(0);
+  } else if (strcmp(expr, "kw") == 0) {
+    do_checksummed_io(1);
+  } else if (strcmp(expr, "kr") == 0) {
+    do_checksummed_io(0);
+  } else if (strcmp(expr, "cp") == 0) {
+    do_copy();
+  } else {
+    usage();
+    exit(EXIT_SUCCESS);
+  }
+  return;
+}
+
+
+/* Rerun the experiment on nested sub-communicators of 1, 2, 4, ... nodes
+   (or ranks) and finally all of them, in a single allocation. Ranks
+   outside the current step wait at the barrier. */
+void do_scaling_series()
+{
+  MPI_Comm node_comm, step_comm;
+  int world_rank, world_size;
+  int node_rank, node_first, node_index, node_count, unit, unit_count;
+  int step, step_count, members, member;
+  int saved_m_size = m_size;
+  int *steps_units, *steps_procs;
+  double *steps_bw;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+  /* Number nodes in the order of their first rank */
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank,
+		      MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  node_first = (node_rank == 0);
+  node_index = 0;
+  MPI_Exscan(&node_first, &node_index, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (world_rank == 0) node_index = 0;
+  MPI_Bcast(&node_index, 1, MPI_INT, 0, node_comm);
+  MPI_Allreduce(&node_first, &node_count, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Comm_free(&node_comm);
+
+  if (strcmp(series, "nodes") == 0) {
+    unit = node_index;
+    unit_count = node_count;
+  } else if (strcmp(series, "ranks") == 0) {
+    unit = world_rank;
+    unit_count = world_size;
+  } else {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  step_count = 0;
+  for (members = 1; members < unit_count; members *= 2) step_count++;
+  step_count++;
+  steps_units = (int*)gio_malloc(sizeof(int) * step_count);
+  steps_procs = (int*)gio_malloc(sizeof(int) * step_count);
+  steps_bw = (double*)gio_malloc(sizeof(double) * step_count);
+
+  for (step = 0; step < step_count; step++) {
+    members = (step == step_count - 1) ? unit_count : 1 << step;
+    member = (unit < members);
+    MPI_Comm_split(MPI_COMM_WORLD, member ? 0 : MPI_UNDEFINED, world_rank, &step_comm);
+    if (member) {
+      gio_comm = step_comm;
+      MPI_Comm_rank(gio_comm, &myrank);
+      MPI_Comm_size(gio_comm, &world_comm_size);
+      m_size = (saved_m_size < world_comm_size) ? saved_m_size : world_comm_size;
+      if (myrank == 0) {
+	gio_print("===============================================");
+	gio_print("Scaling step %d: %d %s, %d processes", step, members, series, world_comm_size);
+      }
+      do_experiment();
+      steps_units[step] = members;
+      steps_procs[step] = world_comm_size;
+      steps_bw[step] = last_io_bandwidth;
+      MPI_Comm_free(&step_comm);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+
+  gio_comm = MPI_COMM_WORLD;
+  myrank = world_rank;
+  world_comm_size = world_size;
+  m_size = saved_m_size;
+
+  /* World rank 0 is in every step and holds every result */
+  if (myrank == 0) {
+    gio_print("===============================================");
+    gio_print("Scaling series (%s scaling)", strcmp(scale, "s") == 0 ? "strong" : "weak");
+    gio_print("%s\tprocesses\tio bandwidth(MB/s)", series);
+    for (step = 0; step < step_count; step++) {
+      if (steps_bw[step] < 0) {
+	gio_print("%d\t%d\t\t-", steps_units[step], steps_procs[step]);
+      } else {
+	gio_print("%d\t%d\t\t%f", steps_units[step], steps_procs[step], steps_bw[step] / 1e6);
+      }
+    }
+  }
+
+  gio_free(steps_units);
+  gio_free(steps_procs);
+  gio_free(steps_bw);
   return;
 }
 
 void usage()
 {
   if (myrank == 0) {
-    fprintf(stderr, "usage: gio -e [sw|sr|pw|pr] -s [s|w] -f size -d directory\n");
+    fprintf(stderr, "usage: gio -e [sw|sr|pw|pr|nw|tw|tr|tune|mw|bw|rr|zw|zr|kw|kr|cp] -s [s|w] -f size -d directory\n");
     fprintf(stderr, "Where:\n");
     fprintf(stderr, "\t-e       =>" 
 	    " Experiment type: (sw/sr:sequencial write/read, "
-                               "pw/pr:collective write/read with MPI-IO,)\n"
+                               "pw/pr:collective write/read with MPI-IO, "
+                               "nw:node-aggregated write through shared memory, "
+                               "tw/tr:multi-threaded write/read per rank, "
+                               "tune:search MPI-IO hints for pw, "
+                               "mw:pw over a set of file counts, "
+                               "bw:write to a local tier (-B) and drain to -d in the background, "
+                               "rr:read pw files written by -W ranks on any number of ranks, "
+                               "zw/zr:write/read with pipelined compression, "
+                               "kw/kr:write/read with pipelined CRC32C checksums, "
+                               "cp:parallel copy of -u to -d)\n"
 	    );
     fprintf(stderr, "\t-s       => " 
 	    "s:strong scale, w:weak scale\n");
     fprintf(stderr, "\t-f       => " 
-	    "d is data size (bytes)\n");
+	    "d is data size (bytes): per rank for weak scaling, in total for strong scaling\n");
+    fprintf(stderr, "\t-a       => " 
+	    "block size (bytes) each rank's share is aligned to for strong scaling (default: 4)\n");
+    fprintf(stderr, "\t-S       => " 
+	    "scaling series over nodes or ranks: 1, 2, 4, ... up to all (default: none)\n");
+    fprintf(stderr, "\t-B       => " 
+	    "staging directory on the fast local tier for bw\n");
+    fprintf(stderr, "\t-C       => " 
+	    "drain buffer size per node (bytes) for bw (default: 4194304)\n");
+    fprintf(stderr, "\t-R       => " 
+	    "drain throttle per node (MB/s) for bw, 0 is unlimited (default: 0)\n");
+    fprintf(stderr, "\t-W       => " 
+	    "number of ranks that wrote the pw files read by rr (default: same as readers)\n");
+    fprintf(stderr, "\t-z       => " 
+	    "codec for zw: none, lz or zlib (default: lz)\n");
+    fprintf(stderr, "\t-x       => " 
+	    "compression ratio of the data generated for zw/zr, 1 is incompressible (default: 1)\n");
+    fprintf(stderr, "\t-c       => " 
+	    "pipeline chunk (checksum block, copy chunk, read block) size (bytes) for zw/zr, kw/kr, cp and sr (default: 1048576)\n");
+    fprintf(stderr, "\t-u       => " 
+	    "source of cp: a directory (e.g. one with gio-file.* outputs) or file[,file...]\n");
+    fprintf(stderr, "\t-y       => " 
+	    "first copy method tried by cp: copy_file_range, splice or rw (default: copy_file_range)\n");
+    fprintf(stderr, "\t-r       => " 
+	    "prefetch of sr: none, fadvise, readahead or thread; compared against a plain read (default: none)\n");
+    fprintf(stderr, "\t-w       => " 
+	    "prefetch window (bytes) kept ahead of the reader by sr (default: 8388608)\n");
+    fprintf(stderr, "\t-F       => " 
+	    "fan-out: per-rank files are spread (rank modulo) over this many gio-dir.* subdirectories of -d, 0 is none (default: 0)\n");
+    fprintf(stderr, "\t-O       => " 
+	    "open admission of per-rank files for sw/sr, zw/zr and kw/kr: none, token or window (default: none)\n");
+    fprintf(stderr, "\t-k       => " 
+	    "ranks opening at a time under -O (default: 64)\n");
+    fprintf(stderr, "\t-N       => " 
+	    "background load during the io phase: alltoall, neighbor or membw; the experiment runs with and without it (default: none)\n");
+    fprintf(stderr, "\t-g       => " 
+	    "bytes per round of -N: sent per rank (alltoall), per neighbor (neighbor) or per array (membw) (default: 1048576, membw: 67108864)\n");
+    fprintf(stderr, "\t-q       => " 
+	    "quiet/loaded pairs run by -N after a warm-up run, in alternating order (default: 2)\n");
     fprintf(stderr, "\t-d       => " 
 	    "target directory\n");
+    fprintf(stderr, "\t-m       => " 
+	    "number of files for pw/pr (M of NxM)\n");
+    fprintf(stderr, "\t-M       => " 
+	    "file counts tried by mw: all, or a list like 1,2,4-8 (default: all)\n");
+    fprintf(stderr, "\t-l       => " 
+	    "leader (writer) ranks per node for nw (default: 1)\n");
+    fprintf(stderr, "\t-t       => " 
+	    "I/O threads per rank for tw/tr (default: 1)\n");
+    fprintf(stderr, "\t-b       => " 
+	    "I/O backend for tw/tr and kw/kr: posix or mpiio (default: posix)\n");
+    fprintf(stderr, "\t-p       => " 
+	    "thread pinning: none, compact or scatter (default: none)\n");
+    fprintf(stderr, "\t-n       => " 
+	    "thread buffers: local (first touch by each thread) or master (default: local)\n");
+    fprintf(stderr, "\t-i       => " 
+	    "MPI-IO hints: key=value[,key=value...] (e.g. striping_unit, cb_nodes, romio_cb_write)\n");
+    fprintf(stderr, "\t-I       => " 
+	    "MPI-IO hints file: one \"key value\" per line\n");
     fprintf(stderr, "\n");
   }
 }
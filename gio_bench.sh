@@ -0,0 +1,182 @@
+#!/bin/sh
+#
+# Local benchmark suite: runs a matrix of gio experiments with mpirun on
+# this host against a tmpfs directory, writes the results as CSV and
+# JSON, and compares them against a stored baseline.
+#
+#   gio_bench.sh run      run the matrix, write $OUT.csv and $OUT.json
+#   gio_bench.sh compare  compare $OUT.csv against $BASELINE, exit 1 on
+#                         a slowdown beyond $TOLERANCE percent; skipped
+#                         when there is no baseline
+#
+# Settings are taken from the environment (see the defaults below). The
+# files are written to a fresh directory created under $DIR, which is
+# the only thing removed afterwards. Every experiment is run $REPEAT
+# times and its median kept; SIZE bytes per rank make the io phase long
+# enough to time, and TOLERANCE sits above the run-to-run noise of two
+# back-to-back runs of one binary (up to 32% with 4 ranks on one core,
+# peaking at about 3 GB in $DIR).
+
+GIO=${GIO:-./gio}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe -np"}
+NP=${NP:-4}
+SIZE=${SIZE:-67108864}
+DIR=${DIR:-/dev/shm}
+REPEAT=${REPEAT:-5}
+OUT=${OUT:-bench}
+BASELINE=${BASELINE:-bench_baseline.csv}
+TOLERANCE=${TOLERANCE:-40}
+
+# name|options, run in this order on the files of $WORK: readers follow
+# the writers of their files, cp copies the sw files written before it
+matrix()
+{
+    cat <<EOF
+sw|-e sw
+sr|-e sr
+sr-thread|-e sr -r thread
+sr-fadvise|-e sr -r fadvise
+cp|-e cp -u $WORK -d $WORK/copy
+pw|-e pw -m 1
+pr|-e pr -m 1
+pw-n|-e pw -m $NP
+pr-n|-e pr -m $NP
+rr|-e rr -m $NP -W $NP
+mw|-e mw
+tune|-e tune -m 1
+nw|-e nw
+tw|-e tw -t 2
+tr|-e tr -t 2
+bw|-e bw -B $WORK/stage
+zw|-e zw -x 4
+zr|-e zr -x 4
+kw|-e kw
+kr|-e kr
+sw-sharded|-e sw -F 4 -O window -k 2
+sw-series|-e sw -S ranks
+sw-noise|-e sw -N neighbor -q 1
+EOF
+}
+
+now()
+{
+    date +%s.%N
+}
+
+# Median of a list of numbers
+median()
+{
+    printf '%s\n' "$@" | sort -g | awk '{v[NR] = $1} END {print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2}'
+}
+
+# Median of REPEAT runs of one experiment: "io_bw total_bw wall" with the
+# bandwidths in MB/s (0 when the experiment reports none, e.g. mw and
+# tune) and the wall time of the run in seconds. The median rather than
+# the best run, so that one lucky or unlucky run does not decide a
+# comparison.
+run_one()
+{
+    ios=
+    totals=
+    walls=
+    i=0
+    while [ $i -lt "$REPEAT" ]; do
+	start=$(now)
+	log=$($MPIRUN "$NP" "$GIO" -s w -f "$SIZE" -d "$WORK" "$@" < /dev/null 2>&1)
+	if [ $? -ne 0 ]; then
+	    echo "$log" >&2
+	    return 1
+	fi
+	wall=$(awk -v a="$start" -v b="$(now)" 'BEGIN {print b - a}')
+	io=$(echo "$log" | awk -F: '/io bandwidth  / {split($5, v, " "); x = v[1]} END {print x + 0}')
+	total=$(echo "$log" | awk -F: '/total bandwidth / {split($5, v, " "); x = v[1]} END {print x + 0}')
+	ios="$ios $io"
+	totals="$totals $total"
+	walls="$walls $wall"
+	i=$((i + 1))
+    done
+    echo "$(median $ios) $(median $totals) $(median $walls)"
+}
+
+do_run()
+{
+    WORK=$(mktemp -d "$DIR/gio-bench.XXXXXX") || exit 1
+    case "$WORK" in
+	*[[:space:]]*)
+	    echo "bench: $DIR must not contain spaces" >&2
+	    rmdir "$WORK"
+	    exit 1
+	    ;;
+    esac
+    mkdir "$WORK/stage" "$WORK/copy" || { rm -rf "$WORK"; exit 1; }
+
+    echo "experiment,processes,size,io_bw_mbs,total_bw_mbs,wall_s" > "$OUT.csv"
+    matrix | while IFS='|' read name opts; do
+	echo "bench: $name ($opts)" >&2
+	set -- $opts
+	result=$(run_one "$@") || exit 1
+	set -- $result
+	echo "$name,$NP,$SIZE,$1,$2,$3" >> "$OUT.csv"
+    done
+    status=$?
+    rm -rf "$WORK"
+    [ $status -ne 0 ] && exit $status
+    awk -F, 'NR > 1 {
+		 printf("%s  {\"experiment\": \"%s\", \"processes\": %s, \"size\": %s, \"io_bw_mbs\": %s, \"total_bw_mbs\": %s, \"wall_s\": %s}",
+			(NR > 2) ? ",\n" : "[\n", $1, $2, $3, $4, $5, $6)
+	     }
+	     END {print "\n]"}' "$OUT.csv" > "$OUT.json"
+    cat "$OUT.csv"
+}
+
+# Bandwidths are compared when the baseline has them, the wall time always
+do_compare()
+{
+    if [ ! -f "$BASELINE" ]; then
+	echo "bench: no baseline $BASELINE, comparison skipped ('make bench-baseline' stores one)" >&2
+	exit 0
+    fi
+    awk -F, -v tol="$TOLERANCE" '
+	function change(new, old) {
+	    return (old > 0) ? (new - old) / old * 100 : 0
+	}
+	NR == FNR {
+	    if (FNR > 1) {io[$1] = $4; total[$1] = $5; wall[$1] = $6; key[$1] = $2 "," $3}
+	    next
+	}
+	FNR == 1 {next}
+	!($1 in io) {printf("%-12s new, not in the baseline\n", $1); next}
+	{
+	    if (key[$1] != $2 "," $3) {
+		printf("%-12s processes,size %s differ from the baseline %s\n", $1, $2 "," $3, key[$1])
+		failed = 1
+		next
+	    }
+	    dio = change($4, io[$1])
+	    dtotal = change($5, total[$1])
+	    dwall = change($6, wall[$1])
+	    slow = (dio < -tol || dtotal < -tol || dwall > tol)
+	    printf("%-12s io %10.1f MB/s (%+6.1f%%)  total %10.1f MB/s (%+6.1f%%)  wall %7.2f s (%+6.1f%%)%s\n",
+		   $1, $4, dio, $5, dtotal, $6, dwall, slow ? "  SLOWER" : "")
+	    if (slow) failed = 1
+	}
+	END {
+	    if (failed) {
+		printf("bench: slowdown beyond %s%% against the baseline\n", tol)
+		exit 1
+	    }
+	}' "$BASELINE" "$OUT.csv"
+}
+
+case "$1" in
+    run)
+	do_run
+	;;
+    compare)
+	do_compare
+	;;
+    *)
+	echo "usage: $0 run|compare" >&2
+	exit 1
+	;;
+esac
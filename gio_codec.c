@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef GIO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "gio_err.h"
+#include "gio_codec.h"
+
+/* Built-in codec: a small LZ77 in the LZ4 block format. A sequence is a
+   token (literal length:4, match length - 4:4), extra literal length
+   bytes, literals, a 16 bit little endian offset and extra match length
+   bytes. The last sequence has literals only. */
+
+#define LZ_MIN_MATCH   (4)
+#define LZ_HASH_BITS   (14)
+#define LZ_MAX_OFFSET  (65535)
+#define LZ_LAST_LITERALS (5)
+
+/* Filled bytes per page of generated data: incompressible prefix, then a run */
+#define GIO_FILL_PAGE  (4096)
+
+static uint32_t read32(const char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t lz_hash(uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static int lz_put_length(char **op, char *oend, size_t len)
+{
+  while (len >= 255) {
+    if (*op >= oend) return 0;
+    *(*op)++ = (char)255;
+    len -= 255;
+  }
+  if (*op >= oend) return 0;
+  *(*op)++ = (char)len;
+  return 1;
+}
+
+static int lz_put_sequence(char **op, char *oend, const char *lit, size_t lit_len,
+			   size_t offset, size_t match_len)
+{
+  char *token;
+  size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+  if (*op >= oend) return 0;
+  token = (*op)++;
+  *token = (char)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+  if (lit_len >= 15 && !lz_put_length(op, oend, lit_len - 15)) return 0;
+  if ((size_t)(oend - *op) < lit_len) return 0;
+  memcpy(*op, lit, lit_len);
+  *op += lit_len;
+  if (match_len == 0) return 1;
+  if (oend - *op < 2) return 0;
+  *(*op)++ = (char)(offset & 0xff);
+  *(*op)++ = (char)(offset >> 8);
+  if (ml >= 15 && !lz_put_length(op, oend, ml - 15)) return 0;
+  return 1;
+}
+
+/* Returns the compressed size, or 0 if it does not fit in cap */
+static size_t lz_compress(const char* src, size_t size, char* dst, size_t cap)
+{
+  uint32_t table[1 << LZ_HASH_BITS];
+  const char *anchor = src;
+  const char *ip = src;
+  const char *iend = src + size;
+  const char *mlimit = (size > LZ_LAST_LITERALS + LZ_MIN_MATCH) ? iend - LZ_LAST_LITERALS - LZ_MIN_MATCH : src;
+  char *op = dst;
+  char *oend = dst + cap;
+
+  memset(table, 0, sizeof(table));
+  while (ip < mlimit) {
+    uint32_t h = lz_hash(read32(ip));
+    const char *ref = src + table[h];
+    table[h] = (uint32_t)(ip - src);
+    if (ref < ip && ip - ref <= LZ_MAX_OFFSET && read32(ref) == read32(ip)) {
+      size_t len = LZ_MIN_MATCH;
+      while (ip + len < iend - LZ_LAST_LITERALS && ref[len] == ip[len]) len++;
+      if (!lz_put_sequence(&op, oend, anchor, ip - anchor, ip - ref, len)) return 0;
+      ip += len;
+      anchor = ip;
+    } else {
+      /* Skip faster through data that does not compress */
+      ip += 1 + ((ip - anchor) >> 6);
+    }
+  }
+  if (!lz_put_sequence(&op, oend, anchor, iend - anchor, 0, 0)) return 0;
+  return op - dst;
+}
+
+static int lz_get_length(const char **ip, const char *iend, size_t *len)
+{
+  unsigned char c;
+  do {
+    if (*ip >= iend) return 0;
+    c = (unsigned char)*(*ip)++;
+    *len += c;
+  } while (c == 255);
+  return 1;
+}
+
+/* Returns the decompressed size, or 0 on corrupted input */
+static size_t lz_decompress(const char* src, size_t size, char* dst, size_t cap)
+{
+  const char *ip = src;
+  const char *iend = src + size;
+  char *op = dst;
+  char *oend = dst + cap;
+  size_t lit_len, match_len, offset;
+  unsigned char token;
+
+  while (ip < iend) {
+    token = (unsigned char)*ip++;
+    lit_len = token >> 4;
+    if (lit_len == 15 && !lz_get_length(&ip, iend, &lit_len)) return 0;
+    if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len) return 0;
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == iend) break;
+
+    if (iend - ip < 2) return 0;
+    offset = (unsigned char)ip[0] | ((unsigned char)ip[1] << 8);
+    ip += 2;
+    match_len = token & 15;
+    if (match_len == 15 && !lz_get_length(&ip, iend, &match_len)) return 0;
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(oend - op) < match_len) return 0;
+    /* Byte by byte: the match may overlap the output */
+    while (match_len--) {
+      *op = *(op - offset);
+      op++;
+    }
+  }
+  return op - dst;
+}
+
+int gio_codec_id(const char* name)
+{
+  if (strcmp(name, "none") == 0) return GIO_CODEC_NONE;
+  if (strcmp(name, "lz") == 0) return GIO_CODEC_LZ;
+#ifdef GIO_HAVE_ZLIB
+  if (strcmp(name, "zlib") == 0) return GIO_CODEC_ZLIB;
+#else
+  if (strcmp(name, "zlib") == 0) {
+    gio_err("gio is built without zlib (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+#endif
+  gio_err("Unknown codec: %s (%s:%s:%d)", name, __FILE__, __func__, __LINE__);
+  return -1;
+}
+
+const char* gio_codec_name(int codec)
+{
+  switch (codec) {
+  case GIO_CODEC_NONE: return "none";
+  case GIO_CODEC_LZ:   return "lz";
+  case GIO_CODEC_ZLIB: return "zlib";
+  }
+  return "unknown";
+}
+
+/* Largest output of compressing size bytes */
+size_t gio_codec_bound(int codec, size_t size)
+{
+  switch (codec) {
+  case GIO_CODEC_LZ:
+    return size + size / 255 + 16;
+#ifdef GIO_HAVE_ZLIB
+  case GIO_CODEC_ZLIB:
+    return compressBound(size);
+#endif
+  }
+  return size;
+}
+
+/* Returns the compressed size, or 0 if the data does not shrink */
+size_t gio_codec_compress(int codec, const char* src, size_t size, char* dst, size_t cap)
+{
+  size_t n = 0;
+
+  if (cap > size) cap = size;
+  switch (codec) {
+  case GIO_CODEC_LZ:
+    n = lz_compress(src, size, dst, cap);
+    break;
+#ifdef GIO_HAVE_ZLIB
+  case GIO_CODEC_ZLIB: {
+    uLongf len = cap;
+    n = (compress2((Bytef*)dst, &len, (const Bytef*)src, size, 1) == Z_OK) ? len : 0;
+    break;
+  }
+#endif
+  }
+  return (n < size) ? n : 0;
+}
+
+/* Returns the decompressed size, or 0 on corrupted input */
+size_t gio_codec_decompress(int codec, const char* src, size_t size, char* dst, size_t cap)
+{
+  switch (codec) {
+  case GIO_CODEC_NONE:
+    if (size > cap) return 0;
+    memcpy(dst, src, size);
+    return size;
+  case GIO_CODEC_LZ:
+    return lz_decompress(src, size, dst, cap);
+#ifdef GIO_HAVE_ZLIB
+  case GIO_CODEC_ZLIB: {
+    uLongf len = cap;
+    return (uncompress((Bytef*)dst, &len, (const Bytef*)src, size) == Z_OK) ? len : 0;
+  }
+#endif
+  }
+  return 0;
+}
+
+/* Deterministic test data that compresses by about ratio: every page
+   starts with page/ratio pseudo random bytes and ends with a run. The
+   bytes only depend on seed and the absolute offset, so a reader can
+   regenerate any part of them. */
+void gio_codec_fill(char* buf, size_t size, size_t offset, double ratio, unsigned int seed)
+{
+  size_t i, pos, page, random_len;
+  uint64_t x;
+
+  if (ratio < 1.0) ratio = 1.0;
+  random_len = (size_t)(GIO_FILL_PAGE / ratio);
+  for (i = 0; i < size; i++) {
+    pos = offset + i;
+    page = pos / GIO_FILL_PAGE;
+    if (pos % GIO_FILL_PAGE < random_len) {
+      /* splitmix64 of (seed, position) */
+      x = ((uint64_t)seed << 40) ^ pos;
+      x += 0x9e3779b97f4a7c15ULL;
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      buf[i] = (char)x;
+    } else {
+      buf[i] = (char)(page + seed);
+    }
+  }
+  return;
+}
@@ -0,0 +1,18 @@
+#ifndef GIO_CODEC_H
+#define GIO_CODEC_H
+
+#include <stddef.h>
+
+#define GIO_CODEC_NONE (0)
+#define GIO_CODEC_LZ   (1)
+#define GIO_CODEC_ZLIB (2)
+
+int gio_codec_id(const char* name);
+const char* gio_codec_name(int codec);
+size_t gio_codec_bound(int codec, size_t size);
+size_t gio_codec_compress(int codec, const char* src, size_t size, char* dst, size_t cap);
+size_t gio_codec_decompress(int codec, const char* src, size_t size, char* dst, size_t cap);
+
+void gio_codec_fill(char* buf, size_t size, size_t offset, double ratio, unsigned int seed);
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "gio_crc.h"
+
+/* CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU
+   has it, and slicing-by-8 tables otherwise. */
+
+#define CRC32C_POLY (0x82f63b78)
+
+static uint32_t crc_table[8][256];
+static int crc_hw = 0;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+  uint32_t crc;
+  int i, j;
+
+  for (i = 0; i < 256; i++) {
+    crc = i;
+    for (j = 0; j < 8; j++) {
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    crc_table[0][i] = crc;
+  }
+  for (i = 0; i < 256; i++) {
+    for (j = 1; j < 8; j++) {
+      crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xff];
+    }
+  }
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  crc_hw = __builtin_cpu_supports("sse4.2");
+#endif
+  return;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char* p, size_t size)
+{
+  uint64_t v;
+
+  while (size && ((uintptr_t)p & 7)) {
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+    size--;
+  }
+  while (size >= 8) {
+    memcpy(&v, p, sizeof(v));
+    v ^= crc;
+    crc = crc_table[7][v & 0xff] ^
+      crc_table[6][(v >> 8) & 0xff] ^
+      crc_table[5][(v >> 16) & 0xff] ^
+      crc_table[4][(v >> 24) & 0xff] ^
+      crc_table[3][(v >> 32) & 0xff] ^
+      crc_table[2][(v >> 40) & 0xff] ^
+      crc_table[1][(v >> 48) & 0xff] ^
+      crc_table[0][v >> 56];
+    p += 8;
+    size -= 8;
+  }
+  while (size--) {
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t size)
+{
+  uint64_t c = crc, v;
+
+  while (size && ((uintptr_t)p & 7)) {
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+    size--;
+  }
+  while (size >= 8) {
+    memcpy(&v, p, sizeof(v));
+    c = _mm_crc32_u64(c, v);
+    p += 8;
+    size -= 8;
+  }
+  while (size--) {
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+  }
+  return (uint32_t)c;
+}
+#endif
+
+/* Continue crc over buf; start with crc = 0 */
+uint32_t gio_crc32c(uint32_t crc, const void* buf, size_t size)
+{
+  pthread_once(&crc_once, crc_init);
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (crc_hw) {
+    return ~crc32c_hw(crc, (const unsigned char*)buf, size);
+  }
+#endif
+  return ~crc32c_sw(crc, (const unsigned char*)buf, size);
+}
+
+const char* gio_crc32c_impl(void)
+{
+  pthread_once(&crc_once, crc_init);
+  return crc_hw ? "sse4.2" : "slicing-by-8";
+}
@@ -0,0 +1,10 @@
+#ifndef GIO_CRC_H
+#define GIO_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t gio_crc32c(uint32_t crc, const void* buf, size_t size);
+const char* gio_crc32c_impl(void);
+
+#endif
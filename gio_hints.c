@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <mpi.h>
+
+#include "gio_err.h"
+#include "gio_hints.h"
+
+/* MPI-IO hints given on the command line (-i) or in a hints file (-I).
+   They are applied on top of the defaults of each experiment, so that
+   anything set here wins. */
+struct gio_hint {
+  char key[GIO_HINT_LEN];
+  char val[GIO_HINT_LEN];
+};
+
+static struct gio_hint hints[GIO_HINTS_MAX];
+static int hint_count = 0;
+
+static char* trim(char *str)
+{
+  char *end;
+  while (isspace((unsigned char)*str)) str++;
+  end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) end--;
+  *end = '\0';
+  return str;
+}
+
+void gio_hints_set(const char* key, const char* val)
+{
+  int i;
+
+  if (strlen(key) >= GIO_HINT_LEN || strlen(val) >= GIO_HINT_LEN) {
+    gio_err("Hint is too long: %s=%s (%s:%s:%d)", key, val, __FILE__, __func__, __LINE__);
+  }
+  for (i = 0; i < hint_count; i++) {
+    if (strcmp(hints[i].key, key) == 0) {
+      strcpy(hints[i].val, val);
+      return;
+    }
+  }
+  if (hint_count == GIO_HINTS_MAX) {
+    gio_err("Too many hints (max %d) (%s:%s:%d)", GIO_HINTS_MAX, __FILE__, __func__, __LINE__);
+  }
+  strcpy(hints[hint_count].key, key);
+  strcpy(hints[hint_count].val, val);
+  hint_count++;
+  return;
+}
+
+const char* gio_hints_get(const char* key)
+{
+  int i;
+  for (i = 0; i < hint_count; i++) {
+    if (strcmp(hints[i].key, key) == 0) {
+      return hints[i].val;
+    }
+  }
+  return NULL;
+}
+
+void gio_hints_unset(const char* key)
+{
+  int i;
+  for (i = 0; i < hint_count; i++) {
+    if (strcmp(hints[i].key, key) == 0) {
+      hints[i] = hints[--hint_count];
+      return;
+    }
+  }
+  return;
+}
+
+/* Parse "key=value[,key=value...]" */
+void gio_hints_parse(const char* str)
+{
+  char *copy, *tok, *save, *eq;
+
+  copy = strdup(str);
+  for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+    eq = strchr(tok, '=');
+    if (eq == NULL) {
+      gio_err("Hint must be key=value: %s (%s:%s:%d)", tok, __FILE__, __func__, __LINE__);
+    }
+    *eq = '\0';
+    gio_hints_set(trim(tok), trim(eq + 1));
+  }
+  free(copy);
+  return;
+}
+
+/* Load a hints file: one "key value" or "key=value" per line, '#' starts a comment */
+void gio_hints_load(const char* file)
+{
+  FILE *fp;
+  char line[GIO_HINT_LEN * 2 + 2];
+  char *p, *key, *val;
+
+  if ((fp = fopen(file, "r")) == NULL) {
+    gio_err("Opening hints file: fopen(%s) %m (%s:%s:%d)", file, __FILE__, __func__, __LINE__);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if ((p = strchr(line, '#')) != NULL) *p = '\0';
+    key = trim(line);
+    if (*key == '\0') continue;
+    val = key + strcspn(key, "= \t");
+    if (*val == '\0') {
+      gio_err("Hint has no value in %s: %s (%s:%s:%d)", file, key, __FILE__, __func__, __LINE__);
+    }
+    *val++ = '\0';
+    gio_hints_set(trim(key), trim(val + strspn(val, "= \t")));
+  }
+  fclose(fp);
+  return;
+}
+
+void gio_hints_apply(MPI_Info info)
+{
+  int i;
+  for (i = 0; i < hint_count; i++) {
+    MPI_Info_set(info, hints[i].key, hints[i].val);
+  }
+  return;
+}
+
+void gio_hints_print(void)
+{
+  int i;
+  for (i = 0; i < hint_count; i++) {
+    gio_print("hint                : %s = %s", hints[i].key, hints[i].val);
+  }
+  return;
+}
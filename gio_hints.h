@@ -0,0 +1,17 @@
+#ifndef GIO_HINTS_H
+#define GIO_HINTS_H
+
+#include <mpi.h>
+
+#define GIO_HINTS_MAX (64)
+#define GIO_HINT_LEN  (128)
+
+void gio_hints_set(const char* key, const char* val);
+const char* gio_hints_get(const char* key);
+void gio_hints_unset(const char* key);
+void gio_hints_parse(const char* str);
+void gio_hints_load(const char* file);
+void gio_hints_apply(MPI_Info info);
+void gio_hints_print(void);
+
+#endif
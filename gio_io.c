@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
@@ -8,6 +9,7 @@
 #include <sys/stat.h>
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <mpi.h>
 
@@ -15,7 +17,8 @@
 #include "gio_err.h"
 
 #define GIO_OPEN_TRIES (30)
-#define GIO_OPEN_USLEEP (100000)
+#define GIO_OPEN_USLEEP (1000)       /* first retry delay */
+#define GIO_OPEN_USLEEP_MAX (1000000) /* cap of the doubling delay */
 
 int gio_open(const char* file, int flags, mode_t  mode)
 {
@@ -31,10 +34,16 @@ int gio_open(const char* file, int flags, mode_t  mode)
             file, errno, __FILE__, __LINE__
 	    );
 
-    /* try again */
+    /* try again, backing off exponentially with jitter so that ranks
+       failing together on a busy metadata server do not retry together */
     int tries = GIO_OPEN_TRIES;
+    useconds_t delay = GIO_OPEN_USLEEP;
+    unsigned int seed = (unsigned int)getpid();
     while (tries && fd < 0) {
-      usleep(GIO_OPEN_USLEEP);
+      usleep(delay / 2 + rand_r(&seed) % (delay / 2 + 1));
+      if (delay < GIO_OPEN_USLEEP_MAX) {
+        delay = (delay * 2 < GIO_OPEN_USLEEP_MAX) ? delay * 2 : GIO_OPEN_USLEEP_MAX;
+      }
       if (mode) { 
         fd = open(file, flags, mode);
       } else {
@@ -150,3 +159,165 @@ ssize_t gio_read(const char* file, int fd, void* buf, size_t size)
     }
   return n;
 }
+
+
+/* reliable positional write, safe to call from several threads on one fd */
+ssize_t gio_pwrite(const char* file, int fd, const void* buf, size_t size, off_t offset)
+{
+  ssize_t n = 0;
+  int retries = 10;
+  while (n < size)
+    {
+      ssize_t rc = pwrite(fd, (char*) buf + n, size - n, offset + n);
+      if (rc > 0) {
+	n += rc;
+      } else if (rc == 0) {
+	gio_err("Error writing %s: pwrite(%d, %x, %ld, %ld) returned 0 @ %s:%d",
+		file, fd, (char*) buf + n, size - n, offset + n, __FILE__, __LINE__
+		);
+	exit(1);
+      } else { /* (rc < 0) */
+	if (errno == EINTR || errno == EAGAIN) {
+	  continue;
+	}
+	retries--;
+	if (retries) {
+	  gio_err("Error writing %s: pwrite(%d, %x, %ld, %ld) errno=%d %m @ %s:%d",
+		  file, fd, (char*) buf + n, size - n, offset + n, errno, __FILE__, __LINE__
+		  );
+	} else {
+	  gio_err("Giving up pwrite to %s: pwrite(%d, %x, %ld, %ld) errno=%d %m @ %s:%d",
+		  file, fd, (char*) buf + n, size - n, offset + n, errno, __FILE__, __LINE__
+		  );
+	  exit(1);
+	}
+      }
+    }
+  return n;
+}
+
+/* reliable positional read, safe to call from several threads on one fd */
+ssize_t gio_pread(const char* file, int fd, void* buf, size_t size, off_t offset)
+{
+  ssize_t n = 0;
+  int retries = 10;
+  while (n < size)
+    {
+      ssize_t rc = pread(fd, (char*) buf + n, size - n, offset + n);
+      if (rc > 0) {
+	n += rc;
+      } else if (rc == 0) {
+	/* EOF */
+	return n;
+      } else { /* (rc < 0) */
+	if (errno == EINTR || errno == EAGAIN) {
+	  continue;
+	}
+	retries--;
+	if (retries) {
+	  gio_err("Error reading %s: pread(%d, %x, %ld, %ld) errno=%d %m @ %s:%d",
+		  file, fd, (char*) buf + n, size - n, offset + n, errno, __FILE__, __LINE__
+		  );
+	} else {
+	  gio_err("Giving up pread of %s: pread(%d, %x, %ld, %ld) errno=%d %m @ %s:%d",
+		  file, fd, (char*) buf + n, size - n, offset + n, errno, __FILE__, __LINE__
+		  );
+	  exit(1);
+	}
+      }
+    }
+  return n;
+}
+
+
+#define GIO_SPLICE_PIPE_SIZE (1 << 20)
+
+static int splice_pipe[2] = {-1, -1};
+static size_t splice_pipe_size = 0;
+
+/* errno values meaning "this copy method does not work for these files" */
+static int copy_unsupported(int err)
+{
+  return err == EXDEV || err == ENOSYS || err == EINVAL || err == EOPNOTSUPP;
+}
+
+static ssize_t copy_cfr(int src_fd, int dst_fd, off_t offset, size_t size)
+{
+  ssize_t n = 0;
+  while (n < size) {
+    loff_t in = offset + n, out = offset + n;
+    ssize_t rc = copy_file_range(src_fd, &in, dst_fd, &out, size - n, 0);
+    if (rc > 0) {
+      n += rc;
+    } else if (rc == 0) {
+      return n;
+    } else if (errno != EINTR && errno != EAGAIN) {
+      return (n == 0) ? -1 : n;
+    }
+  }
+  return n;
+}
+
+static ssize_t copy_splice(int src_fd, int dst_fd, off_t offset, size_t size)
+{
+  ssize_t n = 0;
+
+  if (splice_pipe[0] < 0) {
+    if (pipe(splice_pipe) != 0) return -1;
+    fcntl(splice_pipe[1], F_SETPIPE_SZ, GIO_SPLICE_PIPE_SIZE);
+    splice_pipe_size = fcntl(splice_pipe[1], F_GETPIPE_SZ);
+  }
+  while (n < size) {
+    loff_t in = offset + n, out = offset + n;
+    size_t len = (size - n < splice_pipe_size) ? size - n : splice_pipe_size;
+    ssize_t rc = splice(src_fd, &in, splice_pipe[1], NULL, len, SPLICE_F_MOVE);
+    if (rc == 0) return n;
+    if (rc < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      return (n == 0) ? -1 : n;
+    }
+    while (rc > 0) {
+      ssize_t w = splice(splice_pipe[0], NULL, dst_fd, &out, rc, SPLICE_F_MOVE);
+      if (w < 0) {
+	if (errno == EINTR || errno == EAGAIN) continue;
+	gio_err("splice to fd %d failed: errno=%d %m @ %s:%d", dst_fd, errno, __FILE__, __LINE__);
+      }
+      rc -= w;
+      n += w;
+    }
+  }
+  return n;
+}
+
+/* Copy size bytes at offset from src to the same offset of dst, in the
+   kernel if possible. *method is tried first and lowered to the next
+   method (copy_file_range, splice, pread/pwrite with buf) when the
+   kernel or filesystem does not support it. */
+ssize_t gio_copy_range(const char* src, int src_fd, const char* dst, int dst_fd,
+		       off_t offset, size_t size, int *method, char *buf, size_t buf_size)
+{
+  ssize_t n, rc;
+
+  if (*method == GIO_COPY_CFR) {
+    n = copy_cfr(src_fd, dst_fd, offset, size);
+    if (n >= 0) return n;
+    if (!copy_unsupported(errno)) {
+      gio_err("copy_file_range %s to %s failed: errno=%d %m @ %s:%d", src, dst, errno, __FILE__, __LINE__);
+    }
+    *method = GIO_COPY_SPLICE;
+  }
+  if (*method == GIO_COPY_SPLICE) {
+    n = copy_splice(src_fd, dst_fd, offset, size);
+    if (n >= 0) return n;
+    if (!copy_unsupported(errno)) {
+      gio_err("splice %s to %s failed: errno=%d %m @ %s:%d", src, dst, errno, __FILE__, __LINE__);
+    }
+    *method = GIO_COPY_RW;
+  }
+  for (n = 0; n < size; n += rc) {
+    rc = gio_pread(src, src_fd, buf, (size - n < buf_size) ? size - n : buf_size, offset + n);
+    if (rc == 0) break;
+    gio_pwrite(dst, dst_fd, buf, rc, offset + n);
+  }
+  return n;
+}
@@ -3,3 +3,12 @@ int gio_open(const char* file, int flags, mode_t  mode);
 int gio_close(const char* file, int fd);
 ssize_t gio_write(const char* file, int fd, const void* buf, size_t size);
 ssize_t gio_read(const char* file, int fd, void* buf, size_t size);
+ssize_t gio_pwrite(const char* file, int fd, const void* buf, size_t size, off_t offset);
+ssize_t gio_pread(const char* file, int fd, void* buf, size_t size, off_t offset);
+
+#define GIO_COPY_CFR    (0) /* copy_file_range */
+#define GIO_COPY_SPLICE (1) /* splice through a pipe */
+#define GIO_COPY_RW     (2) /* pread/pwrite through a buffer */
+
+ssize_t gio_copy_range(const char* src, int src_fd, const char* dst, int dst_fd,
+		       off_t offset, size_t size, int *method, char *buf, size_t buf_size);
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "gio_err.h"
+#include "gio_mem.h"
+#include "gio_pipe.h"
+#include "gio_util.h"
+
+struct gio_pipe_queue {
+  struct gio_pipe_slot **slots;
+  int head;
+  int count;
+};
+
+struct gio_pipe {
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  struct gio_pipe_slot  *slots;
+  struct gio_pipe_queue free_q;
+  struct gio_pipe_queue full_q;
+  int         depth;
+  int         is_write;
+  int         closing;  /* write pipe: no more slots will be released */
+  int         done;     /* read pipe: fn reported the end of input */
+  long        seq;
+  gio_pipe_fn fn;
+  void        *arg;
+  double      busy;
+};
+
+static void queue_push(struct gio_pipe_queue *q, int depth, struct gio_pipe_slot *slot)
+{
+  q->slots[(q->head + q->count) % depth] = slot;
+  q->count++;
+  return;
+}
+
+static struct gio_pipe_slot* queue_pop(struct gio_pipe_queue *q, int depth)
+{
+  struct gio_pipe_slot *slot = q->slots[q->head];
+  q->head = (q->head + 1) % depth;
+  q->count--;
+  return slot;
+}
+
+static void* pipe_main(void *arg)
+{
+  struct gio_pipe *p = (struct gio_pipe*)arg;
+  struct gio_pipe_queue *in, *out;
+  struct gio_pipe_slot *slot;
+  double start;
+  int more;
+
+  /* The I/O thread consumes full slots of a write pipe, free slots of a read pipe */
+  in  = p->is_write ? &p->full_q : &p->free_q;
+  out = p->is_write ? &p->free_q : &p->full_q;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (in->count == 0 && !p->closing) {
+      pthread_cond_wait(&p->cond, &p->lock);
+    }
+    /* A closing write pipe drains what was released, a read pipe stops */
+    if (in->count == 0 || (!p->is_write && p->closing)) break;
+    slot = queue_pop(in, p->depth);
+    if (!p->is_write) slot->seq = p->seq++;
+    pthread_mutex_unlock(&p->lock);
+
+    start = gio_get_time();
+    more = p->fn(p->arg, slot);
+    p->busy += gio_get_time() - start;
+
+    pthread_mutex_lock(&p->lock);
+    if (!p->is_write && !more) {
+      queue_push(in, p->depth, slot);
+      p->done = 1;
+      pthread_cond_broadcast(&p->cond);
+      break;
+    }
+    queue_push(out, p->depth, slot);
+    pthread_cond_broadcast(&p->cond);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+struct gio_pipe* gio_pipe_create(int depth, size_t size, int is_write, gio_pipe_fn fn, void *arg)
+{
+  struct gio_pipe *p;
+  int i;
+
+  p = (struct gio_pipe*)gio_malloc(sizeof(struct gio_pipe));
+  p->slots = (struct gio_pipe_slot*)gio_malloc(sizeof(struct gio_pipe_slot) * depth);
+  p->free_q.slots = (struct gio_pipe_slot**)gio_malloc(sizeof(struct gio_pipe_slot*) * depth);
+  p->full_q.slots = (struct gio_pipe_slot**)gio_malloc(sizeof(struct gio_pipe_slot*) * depth);
+  p->free_q.head = p->free_q.count = 0;
+  p->full_q.head = p->full_q.count = 0;
+  p->depth = depth;
+  p->is_write = is_write;
+  p->closing = 0;
+  p->done = 0;
+  p->seq = 0;
+  p->fn = fn;
+  p->arg = arg;
+  p->busy = 0;
+  for (i = 0; i < depth; i++) {
+    p->slots[i].buf = (char*)gio_malloc(size);
+    p->slots[i].size = size;
+    p->slots[i].len = 0;
+    p->slots[i].seq = 0;
+    queue_push(&p->free_q, depth, &p->slots[i]);
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  if (pthread_create(&p->thread, NULL, pipe_main, p) != 0) {
+    gio_err("pthread_create failed  (%s:%s:%d)", __FILE__, __func__, __LINE__);
+  }
+  return p;
+}
+
+/* Write pipe: next free slot to fill. Read pipe: next filled slot, or
+   NULL at the end of input. */
+struct gio_pipe_slot* gio_pipe_acquire(struct gio_pipe *p)
+{
+  struct gio_pipe_queue *q = p->is_write ? &p->free_q : &p->full_q;
+  struct gio_pipe_slot *slot = NULL;
+
+  pthread_mutex_lock(&p->lock);
+  while (q->count == 0 && !(!p->is_write && p->done)) {
+    pthread_cond_wait(&p->cond, &p->lock);
+  }
+  if (q->count > 0) {
+    slot = queue_pop(q, p->depth);
+    if (p->is_write) slot->seq = p->seq++;
+  }
+  pthread_mutex_unlock(&p->lock);
+  return slot;
+}
+
+void gio_pipe_release(struct gio_pipe *p, struct gio_pipe_slot *slot)
+{
+  pthread_mutex_lock(&p->lock);
+  queue_push(p->is_write ? &p->full_q : &p->free_q, p->depth, slot);
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  return;
+}
+
+/* Write pipe: waits until every released slot went through fn.
+   Returns the time the I/O thread spent in fn. */
+double gio_pipe_destroy(struct gio_pipe *p)
+{
+  double busy;
+  int i;
+
+  pthread_mutex_lock(&p->lock);
+  p->closing = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->thread, NULL);
+  busy = p->busy;
+
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->cond);
+  for (i = 0; i < p->depth; i++) {
+    gio_free(p->slots[i].buf);
+  }
+  gio_free(p->free_q.slots);
+  gio_free(p->full_q.slots);
+  gio_free(p->slots);
+  gio_free(p);
+  return busy;
+}
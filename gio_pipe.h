@@ -0,0 +1,28 @@
+#ifndef GIO_PIPE_H
+#define GIO_PIPE_H
+
+#include <stddef.h>
+
+/* Bounded pipeline between the calling thread and one I/O thread.
+   Write pipe: the caller fills free slots and releases them, the I/O
+   thread runs fn on each in order and recycles it.
+   Read pipe: the I/O thread runs fn to fill free slots, the caller
+   acquires them in order and releases them after use. */
+struct gio_pipe_slot {
+  char   *buf;
+  size_t size;  /* capacity of buf */
+  size_t len;   /* valid bytes */
+  long   seq;
+};
+
+/* Returns 0 to stop (end of input on a read pipe) */
+typedef int (*gio_pipe_fn)(void *arg, struct gio_pipe_slot *slot);
+
+struct gio_pipe;
+
+struct gio_pipe* gio_pipe_create(int depth, size_t size, int is_write, gio_pipe_fn fn, void *arg);
+struct gio_pipe_slot* gio_pipe_acquire(struct gio_pipe *p);
+void gio_pipe_release(struct gio_pipe *p, struct gio_pipe_slot *slot);
+double gio_pipe_destroy(struct gio_pipe *p);
+
+#endif